@@ -0,0 +1,524 @@
+/*
+    Microbenchmarks of the analysis kernels on synthetic frames.
+    Every frame is generated from a fixed seed: a skin-coloured face on a
+    noisy background with two eyes in the eye band, so the benchmark does not
+    need any recording and gives the same input on every machine.
+    Each kernel is run at several resolutions and reported as ns per pixel
+    of the area it works on and as frames per second.
+
+    Build it like main, against the same image library, e.g.
+        g++ -O2 -pthread bench.cpp eyetrack.cpp <image library> -ljpeg -o bench
+    and run "bench [seconds per kernel]".
+    "bench -check [cases]" instead compares the mask, labelling and median
+    kernels with the library functions they replace on random inputs and
+    exits with 1 if any result differs.
+*/
+
+#include "eyetrack.h"
+#include "jpegio.h"
+#include "binary.h"
+#include "filter.h"
+#include "median.h"
+#include "morphology.h"
+#include "components.h"
+#include "colorkernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+double minSeconds = 0.3;   // time spent on each kernel
+
+/* Deterministic pseudo-random numbers */
+struct Noise {
+	unsigned int state;
+	Noise(unsigned int seed) : state(seed) {}
+	int next(int range){
+		state = state*1664525u + 1013904223u;
+		return (int)((state>>16) % range);
+	}
+};
+
+/* Face box and eye positions of a synthetic frame */
+struct SyntheticFace {
+	int x, y, w, h;
+};
+
+inline int clampColor(int v){
+	return v<0 ? 0 : (v>255 ? 255 : v);
+}
+
+/* Function to generate a face-like frame; gaze moves the irises from -1 (left) to 1 (right) */
+SyntheticFace makeFrame(RGBImage & frame, int width, int height, unsigned int seed, double gaze){
+	SyntheticFace face;
+	Noise noise(seed);
+	int x, y, k;
+
+	frame.resize(width, height);
+	face.w = width*7/20;
+	face.h = height/2;
+	face.x = (width-face.w)/2;
+	face.y = height/5;
+
+	double cx = face.x+face.w/2.0, cy = face.y+face.h/2.0;
+	double eyeY = face.y+face.h*0.30;
+	double eyeX[2] = { face.x+face.w*0.30, face.x+face.w*0.70 };
+	double eyeW = face.w*0.09, eyeH = face.h*0.035, iris = face.h*0.028;
+
+	for(y=0; y<height; y++){
+		for(x=0; x<width; x++){
+			int n = noise.next(17)-8;
+			int r = 70+40*y/height, g = 90+30*y/height, b = 120;      // background
+			double dx = (x-cx)/(face.w/2.0), dy = (y-cy)/(face.h/2.0);
+			if(dx*dx+dy*dy<=1){                                        // skin
+				r = 205; g = 150; b = 120;
+				for(k=0; k<2; k++){
+					double ex = (x-eyeX[k])/eyeW, ey = (y-eyeY)/eyeH;
+					if(ex*ex+ey*ey<=1){                                // eye white
+						r = g = b = 225;
+						double ix = x-(eyeX[k]+gaze*eyeW*0.5), iy = y-eyeY;
+						if(ix*ix+iy*iy<=iris*iris){                    // iris
+							r = 35; g = 25; b = 25;
+						}
+					}
+				}
+			}
+			frame(x,y) = COLOR_RGB(clampColor(r+n), clampColor(g+n), clampColor(b+n));
+		}
+	}
+	return face;
+}
+
+/* Function to time a kernel: seconds per call */
+double timeKernel(std::function<void()> kernel){
+	typedef std::chrono::steady_clock Clock;
+	int calls = 0;
+	double elapsed = 0;
+
+	kernel();   // warm up
+	Clock::time_point start = Clock::now();
+	do{
+		kernel();
+		calls++;
+		elapsed = std::chrono::duration<double>(Clock::now()-start).count();
+	}while(elapsed<minSeconds);
+	return elapsed/calls;
+}
+
+void report(const char * name, int width, int height, long pixels, double seconds){
+	printf("%-32s %5dx%-5d %9ld px %10.2f ns/pixel %10.1f frames/s\n", name, width, height, pixels, seconds*1e9/pixels, 1/seconds);
+}
+
+/* Function to run every kernel at one resolution */
+void benchResolution(int width, int height){
+	RGBImage frame, face, eye, scaled;
+	Image<unsigned char> gray, median, mask, out, strucElem;
+	long pixels = (long)width*height;
+	int k;
+
+	SyntheticFace f = makeFrame(frame, width, height, 12345+width, 0.6);
+	const ColorKernels & kernels = colorKernels();
+	FrameScratch scratch;
+	Session s;
+	setLighting(s, 3);
+	s.outputLevel = OUTPUT_RESULTS;   // the analysis alone, no image is rendered
+
+	// gray image and skin mask of the whole frame, as inputs for the binary kernels
+	gray.resize(width, height);
+	for(int y=0; y<height; y++)
+		kernels.grayRow(rowOf(frame, 0, y), width, &gray(0,y));
+	FrameResult faceFrame;
+	faceFrame.level = OUTPUT_RESULTS;
+	faceFrame.inputImage = frame;
+	faceFrame.face.resize(width, height);
+	int sx, sy, sw, sh;
+	findFaceBox(NULL, scratch, faceFrame, 0, 0, width, height, 0, sx, sy, sw, sh);
+	mask.resize(width, height);
+	for(int y=0; y<height; y++)
+		kernels.lessThanRow(&gray(0,y), width, 128, &mask(0,y));
+	strucElem.resize(11, 11);
+	strucElem.setAll(1);
+	BitMask bits, bitsOut;
+	bits.resize(width, height);
+	bits.setAll(0);
+	for(int y=0; y<height; y++)
+		bits.setRow(y, 0, &mask(0,y), width);
+
+	printf("\n");
+	report("skin segmentation (findFaceBox)", width, height, pixels, timeKernel([&]{
+		faceFrame.face.setAll(0);
+		findFaceBox(NULL, scratch, faceFrame, 0, 0, width, height, 0, sx, sy, sw, sh);
+	}));
+
+	FrameResult result;
+	result.level = OUTPUT_RESULTS;
+	result.outputImage = frame;
+	int eyeBand = f.h/6;
+	long eyePixels = (long)f.w*(eyeBand+eyeBand/2);
+	report("iris/eye thresholds (detectEye)", f.w, eyeBand+eyeBand/2, eyePixels, timeKernel([&]{
+		detectEye(s, scratch, frame, result.outputImage, result, f.x, f.y, f.w, eyeBand);
+	}));
+
+	FaceTrack track;
+	result.inputImage = frame;
+	report("whole frame (analyzeFrame)", width, height, pixels, timeKernel([&]{
+		track.found = 0;
+		analyzeFrame(s, scratch, result, track);
+	}));
+	// the same with the masks in row bands and the eyes searched concurrently on every core
+	TilePool tiles(std::max(1, (int)std::thread::hardware_concurrency())-1);
+	s.tilePool = &tiles;
+	report("whole frame (tile pool)", width, height, pixels, timeKernel([&]{
+		track.found = 0;
+		analyzeFrame(s, scratch, result, track);
+	}));
+	s.tilePool = NULL;
+
+	report("orderStatFilter 9x9", width, height, pixels, timeKernel([&]{
+		median = orderStatFilter(gray, 9, 50);
+	}));
+	report("percentileFilter 9x9", width, height, pixels, timeKernel([&]{
+		percentileFilter(gray, median, 9, 50);
+	}));
+
+	report("binaryDilation+Erosion 11x11", width, height, pixels, timeKernel([&]{
+		out = binaryDilation(mask, strucElem, 5, 5);
+		out = binaryErosion(out, strucElem, 5, 5);
+	}));
+	RectMorphology morph;
+	report("RectMorphology close 11x11", width, height, pixels, timeKernel([&]{
+		morph.close(mask, out, 11, 11, 5, 5);
+	}));
+	report("RectMorphology close 11x11 bits", width, height, pixels, timeKernel([&]{
+		morph.close(bits, bitsOut, 11, 11, 5, 5);
+	}));
+
+	ConnectedComponents cc;
+	report("ConnectedComponents", width, height, pixels, timeKernel([&]{
+		cc.analyzeBinary(mask, EIGHT_CONNECTED);
+	}));
+	ComponentLabeller labeller;
+	report("ComponentLabeller", width, height, pixels, timeKernel([&]{
+		labeller.analyzeBinary(mask, EIGHT_CONNECTED);
+	}));
+	report("ComponentLabeller (bit runs)", width, height, pixels, timeKernel([&]{
+		labeller.analyzeBinary(bits, EIGHT_CONNECTED);
+	}));
+	std::vector<unsigned char> line(width);
+	report("lessThanRow + setRow (bits)", width, height, pixels, timeKernel([&]{
+		for(int y=0; y<height; y++){
+			kernels.lessThanRow(&gray(0,y), width, 128, &line[0]);
+			bits.setRow(y, 0, &line[0], width);
+		}
+	}));
+	long area = 0;
+	report("popcount area (bits)", width, height, pixels, timeKernel([&]{
+		area += bits.count();
+	}));
+
+	// an eye image the size of the eye found at this resolution
+	int eyeWidth = (int)(f.w*0.18), eyeHeight = (int)(f.h*0.07);
+	int black = 0;
+	long momentX = 0, momentY = 0;
+	eye.resize(eyeWidth, eyeHeight);
+	eye.setAll(COLOR_RGB(255,255,255));
+	for(int y=eyeHeight/4; y<eyeHeight*3/4; y++){
+		for(k=eyeWidth/3; k<eyeWidth/2; k++){
+			eye(k,y) = COLOR_RGB(0,0,0);
+			black++;
+			momentX += k;
+			momentY += y;
+		}
+	}
+	report("centerOfMass", eyeWidth, eyeHeight, (long)eyeWidth*eyeHeight, timeKernel([&]{
+		centerOfMass(s, eye, black, momentX, momentY, 1);
+	}));
+	report("scaleRGB x3", eyeWidth, eyeHeight, (long)eyeWidth*eyeHeight*9, timeKernel([&]{
+		scaleRGB(scaled, eye);
+	}));
+
+	char jpegFile[] = "/tmp/benchXXXXXX";
+	int fd = mkstemp(jpegFile);
+	if(fd>=0){
+		close(fd);
+		report("writeJpeg q100", width, height, pixels, timeKernel([&]{
+			writeJpeg(frame, jpegFile, 100);
+		}));
+		report("readJpeg", width, height, pixels, timeKernel([&]{
+			readJpeg(face, jpegFile);
+		}));
+		unlink(jpegFile);
+	}
+	std::vector<unsigned char> jpeg;
+	report("encodeJpeg q100 (memory)", width, height, pixels, timeKernel([&]{
+		encodeJpeg(frame, 100, jpeg);
+	}));
+}
+
+/*
+    Checks of the fast kernels against the library functions they replace,
+    on random masks and images. The sizes are drawn mostly around the 64-pixel
+    words of a BitMask (1, 63, 64, 65, ...) and the structuring element origins
+    include its corners, so the borders and partial words are covered.
+*/
+int checkFailures = 0;
+
+void reportCheck(const char * name, int cases, int failures){
+	printf("%-40s %7d cases %7d mismatches\n", name, cases, failures);
+	checkFailures += failures;
+}
+
+/* Function to draw a width or height for a check */
+int checkSize(Noise & noise, int range){
+	static const int edges[] = { 1, 2, 7, 8, 31, 63, 64, 65, 127, 128, 129, 130 };
+	if(noise.next(2))
+		return edges[noise.next(sizeof(edges)/sizeof(edges[0]))];
+	return 1+noise.next(range);
+}
+
+/* Function to make a random binary mask (0/1) of a random density */
+void randomMask(Noise & noise, Image<unsigned char> & mask, int width, int height){
+	int density = noise.next(101);
+	mask.resize(width, height);
+	for(int y=0; y<height; y++)
+		for(int x=0; x<width; x++)
+			mask(x,y) = noise.next(100)<density;
+}
+
+void toBits(const Image<unsigned char> & mask, BitMask & bits){
+	bits.resize(mask.width(), mask.height());
+	bits.setAll(0);
+	for(int y=0; y<mask.height(); y++)
+		bits.setRow(y, 0, &mask(0,y), mask.width());
+}
+
+int sameMask(const Image<unsigned char> & a, const Image<unsigned char> & b){
+	if(a.width()!=b.width() || a.height()!=b.height())
+		return 0;
+	for(int y=0; y<a.height(); y++)
+		for(int x=0; x<a.width(); x++)
+			if((a(x,y)!=0)!=(b(x,y)!=0))
+				return 0;
+	return 1;
+}
+
+int sameImage(const Image<unsigned char> & a, const Image<unsigned char> & b){
+	if(a.width()!=b.width() || a.height()!=b.height())
+		return 0;
+	for(int y=0; y<a.height(); y++)
+		for(int x=0; x<a.width(); x++)
+			if(a(x,y)!=b(x,y))
+				return 0;
+	return 1;
+}
+
+int sameMask(const Image<unsigned char> & a, const BitMask & b){
+	if(a.width()!=b.width() || a.height()!=b.height())
+		return 0;
+	for(int y=0; y<a.height(); y++){
+		for(int x=0; x<a.width(); x++)
+			if((a(x,y)!=0)!=b(x,y))
+				return 0;
+		if(b.row(y)[b.wordsPerRow()-1] & b.tailMask())   // nothing past the width
+			return 0;
+	}
+	return 1;
+}
+
+/* Function to check setRow, count and next of BitMask against the bytes they pack */
+void checkBitMask(int cases){
+	Noise noise(101);
+	Image<unsigned char> mask;
+	BitMask bits;
+	int failures = 0;
+
+	for(int c=0; c<cases; c++){
+		int width = checkSize(noise, 300), height = 1+noise.next(8);
+		randomMask(noise, mask, width, height);
+		bits.resize(width, height);
+		bits.setAll(0);
+		// each row in pieces at unaligned offsets
+		for(int y=0; y<height; y++){
+			for(int x0=0; x0<width; ){
+				int n = 1+noise.next(width-x0);
+				bits.setRow(y, x0, &mask(x0,y), n);
+				x0 += n;
+			}
+		}
+		int bad = !sameMask(mask, bits);
+		int x0 = noise.next(width), x1 = x0+noise.next(width-x0+1);
+		long total = 0, columns = 0;
+		for(int y=0; y<height; y++){
+			for(int x=0; x<width; x++){
+				total += mask(x,y);
+				columns += mask(x,y) && x>=x0 && x<x1;
+			}
+			for(int value=0; value<2; value++){
+				int from = noise.next(width+1), expected = from;
+				while(expected<width && mask(expected,y)!=value)
+					expected++;
+				bad |= bits.next(y, from, value)!=expected;
+			}
+		}
+		bad |= bits.count()!=total || bits.count(x0, x1)!=columns;
+		failures += bad;
+	}
+	reportCheck("BitMask setRow/count/next", cases, failures);
+}
+
+/* Function to check RectMorphology on images and bit masks against binaryDilation/binaryErosion */
+void checkMorphology(int cases){
+	const char * names[4] = { "dilate", "erode", "close", "open" };
+	Noise noise(202);
+	RectMorphology morph;
+	Image<unsigned char> mask, strucElem, out, expected;
+	BitMask bits, bitsOut;
+	int failures[4] = { 0, 0, 0, 0 }, bitFailures[4] = { 0, 0, 0, 0 };
+
+	for(int c=0; c<cases; c++){
+		int width = checkSize(noise, 200), height = 1+noise.next(70);
+		int sw = 1+noise.next(15), sh = 1+noise.next(15);
+		int ox = noise.next(3) ? noise.next(sw) : (noise.next(2) ? 0 : sw-1);
+		int oy = noise.next(3) ? noise.next(sh) : (noise.next(2) ? 0 : sh-1);
+		randomMask(noise, mask, width, height);
+		toBits(mask, bits);
+		strucElem.resize(sw, sh);
+		strucElem.setAll(1);
+		for(int op=0; op<4; op++){
+			switch(op){
+			case 0:
+				expected = binaryDilation(mask, strucElem, ox, oy);
+				morph.dilate(mask, out, sw, sh, ox, oy);
+				morph.dilate(bits, bitsOut, sw, sh, ox, oy);
+				break;
+			case 1:
+				expected = binaryErosion(mask, strucElem, ox, oy);
+				morph.erode(mask, out, sw, sh, ox, oy);
+				morph.erode(bits, bitsOut, sw, sh, ox, oy);
+				break;
+			case 2:
+				expected = binaryErosion(binaryDilation(mask, strucElem, ox, oy), strucElem, ox, oy);
+				morph.close(mask, out, sw, sh, ox, oy);
+				morph.close(bits, bitsOut, sw, sh, ox, oy);
+				break;
+			default:
+				expected = binaryDilation(binaryErosion(mask, strucElem, ox, oy), strucElem, ox, oy);
+				morph.open(mask, out, sw, sh, ox, oy);
+				morph.open(bits, bitsOut, sw, sh, ox, oy);
+			}
+			failures[op] += !sameMask(expected, out);
+			bitFailures[op] += !sameMask(expected, bitsOut);
+		}
+	}
+	char name[64];
+	for(int op=0; op<4; op++){
+		sprintf(name, "RectMorphology %s (Image)", names[op]);
+		reportCheck(name, cases, failures[op]);
+		sprintf(name, "RectMorphology %s (BitMask)", names[op]);
+		reportCheck(name, cases, bitFailures[op]);
+	}
+}
+
+/* Function to list the components of a labelling as sorted (x, y, w, h, area) */
+template <class Labels>
+std::vector<std::vector<int> > componentList(Labels & labels, std::function<int(int)> area){
+	std::vector<std::vector<int> > list;
+	for(int k=0; k<labels.getNumComponents(); k++){
+		int x, y, w, h;
+		labels.getBoundary(k, x, y, w, h);
+		list.push_back({ y, x, w, h, area(k) });
+	}
+	std::sort(list.begin(), list.end());
+	return list;
+}
+
+/* Function to check ComponentLabeller on images and bit masks against ConnectedComponents */
+void checkComponents(int cases){
+	Noise noise(303);
+	Image<unsigned char> mask;
+	BitMask bits;
+	ConnectedComponents cc;
+	ComponentLabeller labeller;
+	int failures = 0, bitFailures = 0;
+
+	for(int c=0; c<cases; c++){
+		int width = checkSize(noise, 200), height = 1+noise.next(70);
+		int connectivity = noise.next(2) ? EIGHT_CONNECTED : FOUR_CONNECTED;
+		randomMask(noise, mask, width, height);
+		toBits(mask, bits);
+
+		cc.analyzeBinary(mask, connectivity);
+		std::vector<std::vector<int> > expected = componentList(cc, [&](int k){
+			Image<unsigned char> binary = cc.getComponentBinary(k);
+			int n = 0;
+			for(int y=0; y<binary.height(); y++)
+				for(int x=0; x<binary.width(); x++)
+					n += binary(x,y)!=0;
+			return n;
+		});
+		auto area = [&](int k){ return labeller.getStats(k).area; };
+		labeller.analyzeBinary(mask, connectivity);
+		failures += componentList(labeller, area)!=expected;
+		labeller.analyzeBinary(bits, connectivity);
+		bitFailures += componentList(labeller, area)!=expected;
+	}
+	reportCheck("ComponentLabeller (Image)", cases, failures);
+	reportCheck("ComponentLabeller (BitMask)", cases, bitFailures);
+}
+
+/* Function to check percentileFilter, and the same in blocks, against orderStatFilter */
+void checkMedian(int cases){
+	Noise noise(404);
+	Image<unsigned char> image, out, blocks, expected;
+	int failures = 0, blockFailures = 0;
+
+	for(int c=0; c<cases; c++){
+		int width = checkSize(noise, 100), height = 1+noise.next(40);
+		int filterWidth = 1+2*noise.next(7);
+		int percentile = noise.next(4) ? noise.next(101) : 50;
+		int levels = 2+noise.next(255);   // few levels give many equal samples
+		image.resize(width, height);
+		for(int y=0; y<height; y++)
+			for(int x=0; x<width; x++)
+				image(x,y) = noise.next(levels);
+
+		expected = orderStatFilter(image, filterWidth, percentile);
+		percentileFilter(image, out, filterWidth, percentile);
+		failures += !sameImage(expected, out);
+
+		// random tiles covering the image
+		blocks.resize(width, height);
+		int tileW = 1+noise.next(width), tileH = 1+noise.next(height);
+		for(int y0=0; y0<height; y0+=tileH)
+			for(int x0=0; x0<width; x0+=tileW)
+				percentileFilterBlock(image, blocks, filterWidth, percentile,
+					x0, std::min(x0+tileW, width), y0, std::min(y0+tileH, height));
+		blockFailures += !sameImage(expected, blocks);
+	}
+	reportCheck("percentileFilter", cases, failures);
+	reportCheck("percentileFilterBlock", cases, blockFailures);
+}
+
+int main(int argc, char * argv[]){
+	int sizes[][2] = { {320,240}, {640,480}, {1280,720}, {1920,1080} };
+
+	if(argc>1 && !strcmp(argv[1], "-check")){
+		int cases = argc>2 ? atoi(argv[2]) : 2000;
+		checkBitMask(cases);
+		checkMorphology(cases);
+		checkComponents(cases);
+		checkMedian(cases);
+		printf("%s\n", checkFailures ? "MISMATCHES FOUND" : "all kernels match the library");
+		return checkFailures!=0;
+	}
+	if(argc>1)
+		minSeconds = atof(argv[1]);
+
+	printf("Color kernels: %s\n", colorKernels().name);
+	for(size_t k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++)
+		benchResolution(sizes[k][0], sizes[k][1]);
+	return 0;
+}
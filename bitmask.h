@@ -0,0 +1,134 @@
+/*
+    Bit-packed binary mask.
+    A BitMask holds one bit per pixel, 64 pixels per word: bit x%64 of word x/64
+    of its row. The bits past the width of a row are always 0, so a word can be
+    counted or scanned without masking. Reading a pixel returns 0 or 1, so a
+    BitMask can be read wherever an Image<unsigned char> mask is.
+    Thresholds are written a row at a time from the byte masks of the color
+    kernels (setRow), and the area of a mask is a popcount of its words.
+    Like a Plane, it keeps its memory when it is resized.
+*/
+
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+class BitMask {
+public:
+	BitMask() : w(0), h(0), words(0) {}
+
+	void resize(int width, int height){
+		w = width;
+		h = height;
+		words = (w+63)/64;
+		if(bits.size() < (size_t)words*h)
+			bits.resize((size_t)words*h);
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	int wordsPerRow() const { return words; }
+	uint64_t * row(int y) { return &bits[(size_t)y*words]; }
+	const uint64_t * row(int y) const { return &bits[(size_t)y*words]; }
+
+	int operator()(int x, int y) const { return (int)(row(y)[x>>6] >> (x&63)) & 1; }
+	void set(int x, int y){ row(y)[x>>6] |= (uint64_t)1 << (x&63); }
+
+	void setAll(int value){
+		std::fill(bits.begin(), bits.begin()+(size_t)words*h, (uint64_t)0);
+		if(value){
+			for(int y=0; y<h; y++){
+				std::fill(row(y), row(y)+words, ~(uint64_t)0);
+				clearTail(row(y));
+			}
+		}
+	}
+
+	/* Function to set the pixels x0..x0+n-1 of row y from a byte mask (nonzero = set); other pixels are kept */
+	void setRow(int y, int x0, const unsigned char * mask, int n){
+		uint64_t * r = row(y);
+		int x = 0;
+		// unaligned head, then 8 pixels per step
+		for(; x<n && ((x0+x)&7); x++)
+			if(mask[x]) r[(x0+x)>>6] |= (uint64_t)1 << ((x0+x)&63);
+		for(; x+8<=n; x+=8){
+			uint64_t v;
+			memcpy(&v, mask+x, 8);
+			r[(x0+x)>>6] |= (uint64_t)packBytes(v) << ((x0+x)&63);
+		}
+		for(; x<n; x++)
+			if(mask[x]) r[(x0+x)>>6] |= (uint64_t)1 << ((x0+x)&63);
+	}
+
+	/* number of set pixels */
+	long count() const {
+		long n = 0;
+		for(size_t k=0; k<(size_t)words*h; k++)
+			n += __builtin_popcountll(bits[k]);
+		return n;
+	}
+
+	/* number of set pixels in the columns [x0,x1) */
+	long count(int x0, int x1) const {
+		long n = 0;
+		if(x0>=x1)
+			return 0;
+		int first = x0>>6, last = (x1-1)>>6;
+		uint64_t head = ~(uint64_t)0 << (x0&63);
+		uint64_t tail = ~(uint64_t)0 >> (63-((x1-1)&63));
+		for(int y=0; y<h; y++){
+			const uint64_t * r = row(y);
+			if(first==last)
+				n += __builtin_popcountll(r[first] & head & tail);
+			else{
+				n += __builtin_popcountll(r[first] & head);
+				for(int k=first+1; k<last; k++)
+					n += __builtin_popcountll(r[k]);
+				n += __builtin_popcountll(r[last] & tail);
+			}
+		}
+		return n;
+	}
+
+	/* bits past the width of a row */
+	uint64_t tailMask() const {
+		return (w&63) ? ~(uint64_t)0 << (w&63) : 0;
+	}
+	void clearTail(uint64_t * r) const {
+		if(words)
+			r[words-1] &= ~tailMask();
+	}
+
+	/* first x >= from in row y that is set (value 1) or clear (value 0), or the width */
+	int next(int y, int from, int value) const {
+		const uint64_t * r = row(y);
+		if(from>=w)
+			return w;
+		int k = from>>6;
+		uint64_t v = (value ? r[k] : ~r[k]) & (~(uint64_t)0 << (from&63));
+		while(!v){
+			if(++k>=words)
+				return w;
+			v = value ? r[k] : ~r[k];
+		}
+		int x = (k<<6) + __builtin_ctzll(v);
+		return x<w ? x : w;
+	}
+
+private:
+	/* one bit per byte of v, set when the byte is nonzero, gathered into one byte (little-endian) */
+	static unsigned int packBytes(uint64_t v){
+		const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+		v = (((v & low7) + low7) | v) >> 7 & 0x0101010101010101ULL;   // 1 in each nonzero byte
+		return (unsigned int)((v * 0x0102040810204080ULL) >> 56) & 0xFF;
+	}
+
+	std::vector<uint64_t> bits;
+	int w, h, words;
+};
+
+#endif
@@ -0,0 +1,381 @@
+/*
+    Row kernels for the color conversions and thresholds of detectFace and detectEye.
+    They read RGBImage rows directly and produce 8-bit gray values, 0/1 masks or
+    float luma/chroma planes, several pixels at a time.
+    Each kernel has a scalar version, an SSE2 version and an AVX2 version; the
+    fastest one the processor supports is picked the first time it is used.
+
+    The RGBImage pixels are assumed to be 32-bit words with 8 bits per channel,
+    stored row by row. The position of each channel is taken from COLOR_RGB.
+*/
+
+#ifndef COLORKERNELS_H
+#define COLORKERNELS_H
+
+#include <math.h>
+#include "image.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define COLORKERNELS_X86
+#include <immintrin.h>
+#endif
+
+/* bit position of each channel in a pixel */
+struct PixelLayout {
+	int red, green, blue;
+	PixelLayout(){
+		red = shiftOf(COLOR_RGB(255,0,0));
+		green = shiftOf(COLOR_RGB(0,255,0));
+		blue = shiftOf(COLOR_RGB(0,0,255));
+	}
+	static int shiftOf(unsigned int mask){
+		int shift = 0;
+		while(shift<32 && !((mask>>shift)&1))
+			shift++;
+		return shift;
+	}
+};
+
+inline const PixelLayout & pixelLayout(){
+	static PixelLayout layout;
+	return layout;
+}
+
+inline const unsigned int * rowOf(const RGBImage & image, int x, int y){
+	return (const unsigned int *)&image(x,y);
+}
+
+/* smallest r+g+b whose HSI intensity (r+g+b)/(3*255) is not below threshold */
+inline int intensityLimit(double threshold){
+	int sum = 0;
+	while(sum<=765 && sum/3.0/255.0 < threshold)
+		sum++;
+	return sum;
+}
+
+/* smallest gray value whose intensity is not below threshold */
+inline int grayLimit(double threshold){
+	int gray = 0;
+	while(gray<=255 && (3*gray)/3.0/255.0 < threshold)
+		gray++;
+	return gray;
+}
+
+/* ---------------------------------------------------------------- scalar */
+
+/* gray[x] = (r+g+b)/3 */
+inline void grayRowScalar(const unsigned int * src, int n, unsigned char * gray){
+	const PixelLayout & l = pixelLayout();
+	for(int x=0; x<n; x++){
+		unsigned int p = src[x];
+		gray[x] = (((p>>l.red)&255) + ((p>>l.green)&255) + ((p>>l.blue)&255)) / 3;
+	}
+}
+
+/* mask[x] = r+g+b < limit */
+inline void intensityMaskRowScalar(const unsigned int * src, int n, int limit, unsigned char * mask){
+	const PixelLayout & l = pixelLayout();
+	for(int x=0; x<n; x++){
+		unsigned int p = src[x];
+		mask[x] = (int)(((p>>l.red)&255) + ((p>>l.green)&255) + ((p>>l.blue)&255)) < limit;
+	}
+}
+
+/* luma and the two chroma differences of detectFace, in 0..1; max[] is raised to the largest of each */
+inline void ycrcbRowScalar(const unsigned int * src, int n, float * Y, float * Cr, float * Cb, float * max){
+	const PixelLayout & l = pixelLayout();
+	for(int x=0; x<n; x++){
+		unsigned int p = src[x];
+		float r = ((p>>l.red)&255) * (1.0f/255);
+		float g = ((p>>l.green)&255) * (1.0f/255);
+		float b = ((p>>l.blue)&255) * (1.0f/255);
+		float y = 0.299f*r + 0.587f*g + 0.114f*b;
+		Y[x] = y;
+		Cr[x] = 0.7132f*fabsf(r-y);
+		Cb[x] = 0.5647f*fabsf(b-y);
+		if(max[0]<Y[x]) max[0] = Y[x];
+		if(max[1]<Cr[x]) max[1] = Cr[x];
+		if(max[2]<Cb[x]) max[2] = Cb[x];
+	}
+}
+
+/* skin rule of detectFace on planes scaled to 0..255 by scale[] */
+inline void skinMaskRowScalar(const float * Y, const float * Cr, const float * Cb, int n, const float * scale, unsigned char * mask){
+	for(int x=0; x<n; x++){
+		float y = Y[x]*scale[0], cr = Cr[x]*scale[1], cb = Cb[x]*scale[2];
+		mask[x] = y>50 && cb>=60 && cb<=250 && cr>=50 && cr<=250;
+	}
+}
+
+/* mask[x] = gray[x] < limit */
+inline void lessThanRowScalar(const unsigned char * gray, int n, int limit, unsigned char * mask){
+	for(int x=0; x<n; x++)
+		mask[x] = gray[x] < limit;
+}
+
+#ifdef COLORKERNELS_X86
+
+/* ---------------------------------------------------------------- SSE2 */
+
+/* r+g+b of 4 pixels as 32-bit lanes */
+inline __m128i channelSum4(const unsigned int * src){
+	const PixelLayout & l = pixelLayout();
+	__m128i p = _mm_loadu_si128((const __m128i *)src);
+	__m128i m = _mm_set1_epi32(255);
+	__m128i r = _mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.red)), m);
+	__m128i g = _mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.green)), m);
+	__m128i b = _mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.blue)), m);
+	return _mm_add_epi32(_mm_add_epi32(r, g), b);
+}
+
+inline void grayRowSSE2(const unsigned int * src, int n, unsigned char * gray){
+	const __m128i third = _mm_set1_epi16((short)0xAAAB);   // x/3 == (x*0xAAAB)>>17 for 16-bit x
+	int x = 0;
+	for(; x+16<=n; x+=16){
+		__m128i s0 = _mm_packs_epi32(channelSum4(src+x), channelSum4(src+x+4));
+		__m128i s1 = _mm_packs_epi32(channelSum4(src+x+8), channelSum4(src+x+12));
+		s0 = _mm_srli_epi16(_mm_mulhi_epu16(s0, third), 1);
+		s1 = _mm_srli_epi16(_mm_mulhi_epu16(s1, third), 1);
+		_mm_storeu_si128((__m128i *)(gray+x), _mm_packus_epi16(s0, s1));
+	}
+	grayRowScalar(src+x, n-x, gray+x);
+}
+
+inline void intensityMaskRowSSE2(const unsigned int * src, int n, int limit, unsigned char * mask){
+	const __m128i lim = _mm_set1_epi16((short)limit);
+	const __m128i one = _mm_set1_epi16(1);
+	int x = 0;
+	for(; x+16<=n; x+=16){
+		__m128i s0 = _mm_packs_epi32(channelSum4(src+x), channelSum4(src+x+4));
+		__m128i s1 = _mm_packs_epi32(channelSum4(src+x+8), channelSum4(src+x+12));
+		s0 = _mm_and_si128(_mm_cmplt_epi16(s0, lim), one);
+		s1 = _mm_and_si128(_mm_cmplt_epi16(s1, lim), one);
+		_mm_storeu_si128((__m128i *)(mask+x), _mm_packus_epi16(s0, s1));
+	}
+	intensityMaskRowScalar(src+x, n-x, limit, mask+x);
+}
+
+inline float horizontalMax(__m128 v){
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,0,3,2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+	return _mm_cvtss_f32(v);
+}
+
+inline void ycrcbRowSSE2(const unsigned int * src, int n, float * Y, float * Cr, float * Cb, float * max){
+	const PixelLayout & l = pixelLayout();
+	const __m128i m = _mm_set1_epi32(255);
+	const __m128 norm = _mm_set1_ps(1.0f/255);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 maxY = _mm_set1_ps(max[0]), maxCr = _mm_set1_ps(max[1]), maxCb = _mm_set1_ps(max[2]);
+	int x = 0;
+	for(; x+4<=n; x+=4){
+		__m128i p = _mm_loadu_si128((const __m128i *)(src+x));
+		__m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.red)), m)), norm);
+		__m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.green)), m)), norm);
+		__m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(l.blue)), m)), norm);
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.299f), r), _mm_mul_ps(_mm_set1_ps(0.587f), g)), _mm_mul_ps(_mm_set1_ps(0.114f), b));
+		__m128 cr = _mm_mul_ps(_mm_set1_ps(0.7132f), _mm_and_ps(_mm_sub_ps(r, y), absMask));
+		__m128 cb = _mm_mul_ps(_mm_set1_ps(0.5647f), _mm_and_ps(_mm_sub_ps(b, y), absMask));
+		_mm_storeu_ps(Y+x, y);
+		_mm_storeu_ps(Cr+x, cr);
+		_mm_storeu_ps(Cb+x, cb);
+		maxY = _mm_max_ps(maxY, y);
+		maxCr = _mm_max_ps(maxCr, cr);
+		maxCb = _mm_max_ps(maxCb, cb);
+	}
+	max[0] = horizontalMax(maxY);
+	max[1] = horizontalMax(maxCr);
+	max[2] = horizontalMax(maxCb);
+	ycrcbRowScalar(src+x, n-x, Y+x, Cr+x, Cb+x, max);
+}
+
+/* 0/1 bytes of 16 float compare results */
+inline __m128i maskBytes(__m128 a, __m128 b, __m128 c, __m128 d){
+	__m128i ab = _mm_packs_epi32(_mm_castps_si128(a), _mm_castps_si128(b));
+	__m128i cd = _mm_packs_epi32(_mm_castps_si128(c), _mm_castps_si128(d));
+	return _mm_and_si128(_mm_packs_epi16(ab, cd), _mm_set1_epi8(1));
+}
+
+inline __m128 skin4(const float * Y, const float * Cr, const float * Cb, const float * scale){
+	__m128 y = _mm_mul_ps(_mm_loadu_ps(Y), _mm_set1_ps(scale[0]));
+	__m128 cr = _mm_mul_ps(_mm_loadu_ps(Cr), _mm_set1_ps(scale[1]));
+	__m128 cb = _mm_mul_ps(_mm_loadu_ps(Cb), _mm_set1_ps(scale[2]));
+	__m128 s = _mm_cmpgt_ps(y, _mm_set1_ps(50));
+	s = _mm_and_ps(s, _mm_cmpge_ps(cb, _mm_set1_ps(60)));
+	s = _mm_and_ps(s, _mm_cmple_ps(cb, _mm_set1_ps(250)));
+	s = _mm_and_ps(s, _mm_cmpge_ps(cr, _mm_set1_ps(50)));
+	return _mm_and_ps(s, _mm_cmple_ps(cr, _mm_set1_ps(250)));
+}
+
+inline void skinMaskRowSSE2(const float * Y, const float * Cr, const float * Cb, int n, const float * scale, unsigned char * mask){
+	int x = 0;
+	for(; x+16<=n; x+=16){
+		__m128i bytes = maskBytes(skin4(Y+x, Cr+x, Cb+x, scale), skin4(Y+x+4, Cr+x+4, Cb+x+4, scale),
+			skin4(Y+x+8, Cr+x+8, Cb+x+8, scale), skin4(Y+x+12, Cr+x+12, Cb+x+12, scale));
+		_mm_storeu_si128((__m128i *)(mask+x), bytes);
+	}
+	skinMaskRowScalar(Y+x, Cr+x, Cb+x, n-x, scale, mask+x);
+}
+
+inline void lessThanRowSSE2(const unsigned char * gray, int n, int limit, unsigned char * mask){
+	int x = 0;
+	if(limit>255){
+		for(; x<n; x++)
+			mask[x] = 1;
+		return;
+	}
+	// unsigned a<limit is min(a,limit-1)==a
+	const __m128i top = _mm_set1_epi8((char)(limit>0 ? limit-1 : 0));
+	const __m128i one = _mm_set1_epi8(1);
+	for(; limit>0 && x+16<=n; x+=16){
+		__m128i a = _mm_loadu_si128((const __m128i *)(gray+x));
+		_mm_storeu_si128((__m128i *)(mask+x), _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(a, top), a), one));
+	}
+	lessThanRowScalar(gray+x, n-x, limit, mask+x);
+}
+
+/* ---------------------------------------------------------------- AVX2 */
+
+#define COLORKERNELS_AVX2 __attribute__((target("avx2")))
+
+COLORKERNELS_AVX2 inline __m256i channelSum8(const unsigned int * src){
+	const PixelLayout & l = pixelLayout();
+	__m256i p = _mm256_loadu_si256((const __m256i *)src);
+	__m256i m = _mm256_set1_epi32(255);
+	__m256i r = _mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.red)), m);
+	__m256i g = _mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.green)), m);
+	__m256i b = _mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.blue)), m);
+	return _mm256_add_epi32(_mm256_add_epi32(r, g), b);
+}
+
+/* packing works within 128-bit lanes; this puts the 32 bytes back in pixel order */
+COLORKERNELS_AVX2 inline __m256i pixelOrder(__m256i packed){
+	return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0,4,1,5,2,6,3,7));
+}
+
+COLORKERNELS_AVX2 inline void grayRowAVX2(const unsigned int * src, int n, unsigned char * gray){
+	const __m256i third = _mm256_set1_epi16((short)0xAAAB);
+	int x = 0;
+	for(; x+32<=n; x+=32){
+		__m256i s0 = _mm256_packs_epi32(channelSum8(src+x), channelSum8(src+x+8));
+		__m256i s1 = _mm256_packs_epi32(channelSum8(src+x+16), channelSum8(src+x+24));
+		s0 = _mm256_srli_epi16(_mm256_mulhi_epu16(s0, third), 1);
+		s1 = _mm256_srli_epi16(_mm256_mulhi_epu16(s1, third), 1);
+		_mm256_storeu_si256((__m256i *)(gray+x), pixelOrder(_mm256_packus_epi16(s0, s1)));
+	}
+	grayRowSSE2(src+x, n-x, gray+x);
+}
+
+COLORKERNELS_AVX2 inline void intensityMaskRowAVX2(const unsigned int * src, int n, int limit, unsigned char * mask){
+	const __m256i lim = _mm256_set1_epi16((short)limit);
+	const __m256i one = _mm256_set1_epi16(1);
+	int x = 0;
+	for(; x+32<=n; x+=32){
+		__m256i s0 = _mm256_packs_epi32(channelSum8(src+x), channelSum8(src+x+8));
+		__m256i s1 = _mm256_packs_epi32(channelSum8(src+x+16), channelSum8(src+x+24));
+		s0 = _mm256_and_si256(_mm256_cmpgt_epi16(lim, s0), one);
+		s1 = _mm256_and_si256(_mm256_cmpgt_epi16(lim, s1), one);
+		_mm256_storeu_si256((__m256i *)(mask+x), pixelOrder(_mm256_packus_epi16(s0, s1)));
+	}
+	intensityMaskRowSSE2(src+x, n-x, limit, mask+x);
+}
+
+COLORKERNELS_AVX2 inline float horizontalMax8(__m256 v){
+	return horizontalMax(_mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+COLORKERNELS_AVX2 inline void ycrcbRowAVX2(const unsigned int * src, int n, float * Y, float * Cr, float * Cb, float * max){
+	const PixelLayout & l = pixelLayout();
+	const __m256i m = _mm256_set1_epi32(255);
+	const __m256 norm = _mm256_set1_ps(1.0f/255);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 maxY = _mm256_set1_ps(max[0]), maxCr = _mm256_set1_ps(max[1]), maxCb = _mm256_set1_ps(max[2]);
+	int x = 0;
+	for(; x+8<=n; x+=8){
+		__m256i p = _mm256_loadu_si256((const __m256i *)(src+x));
+		__m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.red)), m)), norm);
+		__m256 g = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.green)), m)), norm);
+		__m256 b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srl_epi32(p, _mm_cvtsi32_si128(l.blue)), m)), norm);
+		// separate multiplies and adds, so the results match the other versions exactly
+		__m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.299f), r), _mm256_mul_ps(_mm256_set1_ps(0.587f), g)), _mm256_mul_ps(_mm256_set1_ps(0.114f), b));
+		__m256 cr = _mm256_mul_ps(_mm256_set1_ps(0.7132f), _mm256_and_ps(_mm256_sub_ps(r, y), absMask));
+		__m256 cb = _mm256_mul_ps(_mm256_set1_ps(0.5647f), _mm256_and_ps(_mm256_sub_ps(b, y), absMask));
+		_mm256_storeu_ps(Y+x, y);
+		_mm256_storeu_ps(Cr+x, cr);
+		_mm256_storeu_ps(Cb+x, cb);
+		maxY = _mm256_max_ps(maxY, y);
+		maxCr = _mm256_max_ps(maxCr, cr);
+		maxCb = _mm256_max_ps(maxCb, cb);
+	}
+	max[0] = horizontalMax8(maxY);
+	max[1] = horizontalMax8(maxCr);
+	max[2] = horizontalMax8(maxCb);
+	ycrcbRowSSE2(src+x, n-x, Y+x, Cr+x, Cb+x, max);
+}
+
+COLORKERNELS_AVX2 inline __m256 skin8(const float * Y, const float * Cr, const float * Cb, const float * scale){
+	__m256 y = _mm256_mul_ps(_mm256_loadu_ps(Y), _mm256_set1_ps(scale[0]));
+	__m256 cr = _mm256_mul_ps(_mm256_loadu_ps(Cr), _mm256_set1_ps(scale[1]));
+	__m256 cb = _mm256_mul_ps(_mm256_loadu_ps(Cb), _mm256_set1_ps(scale[2]));
+	__m256 s = _mm256_cmp_ps(y, _mm256_set1_ps(50), _CMP_GT_OQ);
+	s = _mm256_and_ps(s, _mm256_cmp_ps(cb, _mm256_set1_ps(60), _CMP_GE_OQ));
+	s = _mm256_and_ps(s, _mm256_cmp_ps(cb, _mm256_set1_ps(250), _CMP_LE_OQ));
+	s = _mm256_and_ps(s, _mm256_cmp_ps(cr, _mm256_set1_ps(50), _CMP_GE_OQ));
+	return _mm256_and_ps(s, _mm256_cmp_ps(cr, _mm256_set1_ps(250), _CMP_LE_OQ));
+}
+
+COLORKERNELS_AVX2 inline void skinMaskRowAVX2(const float * Y, const float * Cr, const float * Cb, int n, const float * scale, unsigned char * mask){
+	int x = 0;
+	for(; x+32<=n; x+=32){
+		__m256i ab = _mm256_packs_epi32(_mm256_castps_si256(skin8(Y+x, Cr+x, Cb+x, scale)), _mm256_castps_si256(skin8(Y+x+8, Cr+x+8, Cb+x+8, scale)));
+		__m256i cd = _mm256_packs_epi32(_mm256_castps_si256(skin8(Y+x+16, Cr+x+16, Cb+x+16, scale)), _mm256_castps_si256(skin8(Y+x+24, Cr+x+24, Cb+x+24, scale)));
+		__m256i bytes = _mm256_and_si256(_mm256_packs_epi16(ab, cd), _mm256_set1_epi8(1));
+		_mm256_storeu_si256((__m256i *)(mask+x), pixelOrder(bytes));
+	}
+	skinMaskRowSSE2(Y+x, Cr+x, Cb+x, n-x, scale, mask+x);
+}
+
+#endif
+
+/* ---------------------------------------------------------------- dispatch */
+
+struct ColorKernels {
+	void (*grayRow)(const unsigned int *, int, unsigned char *);
+	void (*intensityMaskRow)(const unsigned int *, int, int, unsigned char *);
+	void (*ycrcbRow)(const unsigned int *, int, float *, float *, float *, float *);
+	void (*skinMaskRow)(const float *, const float *, const float *, int, const float *, unsigned char *);
+	void (*lessThanRow)(const unsigned char *, int, int, unsigned char *);
+	const char * name;
+
+	ColorKernels(){
+		grayRow = grayRowScalar;
+		intensityMaskRow = intensityMaskRowScalar;
+		ycrcbRow = ycrcbRowScalar;
+		skinMaskRow = skinMaskRowScalar;
+		lessThanRow = lessThanRowScalar;
+		name = "scalar";
+#ifdef COLORKERNELS_X86
+		grayRow = grayRowSSE2;
+		intensityMaskRow = intensityMaskRowSSE2;
+		ycrcbRow = ycrcbRowSSE2;
+		skinMaskRow = skinMaskRowSSE2;
+		lessThanRow = lessThanRowSSE2;
+		name = "sse2";
+		if(__builtin_cpu_supports("avx2")){
+			grayRow = grayRowAVX2;
+			intensityMaskRow = intensityMaskRowAVX2;
+			ycrcbRow = ycrcbRowAVX2;
+			skinMaskRow = skinMaskRowAVX2;
+			name = "avx2";
+		}
+#endif
+	}
+};
+
+/* the kernels for this processor */
+inline const ColorKernels & colorKernels(){
+	static ColorKernels kernels;
+	return kernels;
+}
+
+#endif
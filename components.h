@@ -0,0 +1,210 @@
+/*
+    Single-pass connected-component labelling.
+    The binary image is scanned once in raster order; provisional labels are
+    joined with a union-find table and every label keeps its area, bounding box
+    and first-order moments, so no per-component image has to be built.
+    Only the previous row of labels is kept, so the memory used is one row
+    plus one entry per provisional label.
+    Components are reported in the order of their first pixel in the scan.
+    The tables keep their capacity, so a labeller that is reused for every
+    frame stops allocating once it has seen the largest image.
+    A BitMask is labelled by runs instead of pixels: each row is cut into runs
+    of set bits with a count-trailing-zeros scan of its words, and a run is
+    joined with the runs of the row above that it touches. The components and
+    their order are the same as with the pixel scan.
+*/
+
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+#include "image.h"
+#include "binary.h"
+#include "bitmask.h"
+
+/* Statistics of one connected component */
+struct ComponentStats {
+	int area;                  // number of pixels
+	int minX, minY, maxX, maxY;
+	long sumX, sumY;           // first-order moments
+
+	int width() const { return maxX-minX+1; }
+	int height() const { return maxY-minY+1; }
+	double centerX() const { return (double)sumX/area; }
+	double centerY() const { return (double)sumY/area; }
+};
+
+class ComponentLabeller {
+public:
+	/* label the nonzero pixels of binary (an Image or a Plane); returns the number of components */
+	template <class Mask>
+	int analyzeBinary(const Mask & binary, int connectivity){
+		int width = binary.width(), height = binary.height();
+		int eight = (connectivity==EIGHT_CONNECTED);
+
+		parent.clear();
+		provisional.clear();
+		previousRow.assign(width+2, -1);
+		currentRow.assign(width+2, -1);
+
+		for(int y=0; y<height; y++){
+			for(int x=0; x<width; x++){
+				int label = -1;
+				if(binary(x,y)){
+					// neighbours already visited: left, and the row above
+					int n[4];
+					n[0] = currentRow[x];       // (x-1,y)
+					n[1] = previousRow[x+1];    // (x,y-1)
+					n[2] = eight ? previousRow[x] : -1;    // (x-1,y-1)
+					n[3] = eight ? previousRow[x+2] : -1;  // (x+1,y-1)
+					for(int k=0; k<4; k++){
+						if(n[k]<0)
+							continue;
+						if(label<0)
+							label = find(n[k]);
+						else
+							label = join(label, n[k]);
+					}
+					if(label<0){
+						label = (int)parent.size();
+						parent.push_back(label);
+						ComponentStats c;
+						c.area = 0;
+						c.minX = c.maxX = x;
+						c.minY = c.maxY = y;
+						c.sumX = c.sumY = 0;
+						provisional.push_back(c);
+					}
+					ComponentStats & c = provisional[label];
+					c.area++;
+					c.sumX += x;
+					c.sumY += y;
+					if(x<c.minX) c.minX = x;
+					if(x>c.maxX) c.maxX = x;
+					if(y<c.minY) c.minY = y;
+					if(y>c.maxY) c.maxY = y;
+				}
+				currentRow[x+1] = label;
+			}
+			previousRow.swap(currentRow);
+			currentRow.assign(width+2, -1);
+		}
+
+		return fold();
+	}
+
+	/* label the set pixels of a bit-packed mask, a run at a time */
+	int analyzeBinary(const BitMask & binary, int connectivity){
+		int width = binary.width(), height = binary.height();
+		int reach = (connectivity==EIGHT_CONNECTED) ? 1 : 0;   // diagonal neighbours
+
+		parent.clear();
+		provisional.clear();
+		previousRuns.clear();
+		for(int y=0; y<height; y++){
+			size_t j = 0;
+			currentRuns.clear();
+			for(int start=binary.next(y, 0, 1); start<width; start=binary.next(y, start, 1)){
+				int end = binary.next(y, start, 0);   // one past the run
+				int label = -1;
+				
+				// runs of the row above that touch [start,end), diagonally for eight-connectivity
+				while(j<previousRuns.size() && previousRuns[j].end+reach <= start)
+					j++;
+				for(size_t k=j; k<previousRuns.size() && previousRuns[k].start < end+reach; k++){
+					if(label<0)
+						label = find(previousRuns[k].label);
+					else
+						label = join(label, previousRuns[k].label);
+				}
+				if(label<0){
+					label = (int)parent.size();
+					parent.push_back(label);
+					ComponentStats c;
+					c.area = 0;
+					c.minX = start;
+					c.maxX = end-1;
+					c.minY = c.maxY = y;
+					c.sumX = c.sumY = 0;
+					provisional.push_back(c);
+				}
+				ComponentStats & c = provisional[label];
+				int n = end-start;
+				c.area += n;
+				c.sumX += (long)(start+end-1)*n/2;
+				c.sumY += (long)y*n;
+				if(start<c.minX) c.minX = start;
+				if(end-1>c.maxX) c.maxX = end-1;
+				if(y>c.maxY) c.maxY = y;
+				
+				Run run = { start, end, label };
+				currentRuns.push_back(run);
+				start = end;
+			}
+			previousRuns.swap(currentRuns);
+		}
+		return fold();
+	}
+
+	int getNumComponents() const { return (int)components.size(); }
+	const ComponentStats & getStats(int c) const { return components[c]; }
+	void getBoundary(int c, int & startX, int & startY, int & width, int & height) const {
+		startX = components[c].minX;
+		startY = components[c].minY;
+		width = components[c].width();
+		height = components[c].height();
+	}
+
+private:
+	struct Run {
+		int start, end, label;   // pixels [start,end) of a row
+	};
+
+	/* Function to fold every label into its root; the root is the smallest label, so the first in the scan */
+	int fold(){
+		components.clear();
+		index.assign(parent.size(), -1);
+		for(size_t l=0; l<parent.size(); l++){
+			int root = find((int)l);
+			if(index[root]<0){
+				index[root] = (int)components.size();
+				components.push_back(provisional[l]);
+			}
+			else
+				merge(components[index[root]], provisional[l]);
+		}
+		return (int)components.size();
+	}
+
+	int find(int l){
+		while(parent[l]!=l){
+			parent[l] = parent[parent[l]];
+			l = parent[l];
+		}
+		return l;
+	}
+
+	int join(int a, int b){
+		a = find(a);
+		b = find(b);
+		if(a<b){ parent[b] = a; return a; }
+		parent[a] = b;
+		return b;
+	}
+
+	static void merge(ComponentStats & to, const ComponentStats & from){
+		to.area += from.area;
+		to.sumX += from.sumX;
+		to.sumY += from.sumY;
+		if(from.minX<to.minX) to.minX = from.minX;
+		if(from.maxX>to.maxX) to.maxX = from.maxX;
+		if(from.minY<to.minY) to.minY = from.minY;
+		if(from.maxY>to.maxY) to.maxY = from.maxY;
+	}
+
+	std::vector<int> parent, index, previousRow, currentRow;
+	std::vector<ComponentStats> provisional, components;
+	std::vector<Run> previousRuns, currentRuns;
+};
+
+#endif
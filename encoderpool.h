@@ -0,0 +1,60 @@
+/*
+    Pool of encoder threads behind a bounded queue.
+    submit() hands an item over to the pool, which encodes it on one of its
+    threads and then releases it: deletes it, or gives it back to its owner
+    through a release function for reuse. The caller never waits for the
+    encoder or the disk unless the queue is full. flush() waits until
+    everything submitted has been encoded; it is also done by the destructor.
+*/
+
+#ifndef ENCODERPOOL_H
+#define ENCODERPOOL_H
+
+#include <vector>
+#include <thread>
+#include <functional>
+#include "queue.h"
+
+template <class T>
+class EncoderPool {
+public:
+	EncoderPool(int numThreads, int capacity, std::function<void(T&)> encode,
+	            std::function<void(T*)> release = [](T * item){ delete item; }) : items(capacity), encode(encode), release(release) {
+		if(numThreads<1)
+			numThreads = 1;
+		for(int i=0; i<numThreads; i++)
+			threads.push_back(std::thread(&EncoderPool::run, this));
+	}
+
+	~EncoderPool(){
+		flush();
+	}
+
+	/* takes ownership of item; blocks while the queue is full */
+	void submit(T * item){
+		items.push(item);
+	}
+
+	void flush(){
+		items.close();
+		for(size_t i=0; i<threads.size(); i++)
+			threads[i].join();
+		threads.clear();
+	}
+
+private:
+	void run(){
+		T * item;
+		while(items.pop(item)){
+			encode(*item);
+			release(item);
+		}
+	}
+
+	BoundedQueue<T*> items;
+	std::function<void(T&)> encode;
+	std::function<void(T*)> release;
+	std::vector<std::thread> threads;
+};
+
+#endif
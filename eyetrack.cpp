@@ -0,0 +1,2010 @@
+/*
+    The eye direction and blink analysis and its drivers, see eyetrack.h.
+*/
+
+#include "eyetrack.h"
+#include "stdio.h"
+#include "jpegio.h"
+#include "binary.h"
+#include "color.h"
+#include "filter.h"
+#include "components.h"
+#include "morphology.h"
+#include "median.h"
+#include "colorkernels.h"
+#include "queue.h"
+#include "workpool.h"
+#include "videoin.h"
+#include "encoderpool.h"
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <map>
+#include <thread>
+
+/* Global Variables */
+int boxWidth=225, boxHeight=225;
+int prevEyeStartX=0, prevEyeStartY=0, prevEyeWidth=0, prevEyeHeight=0;
+RGBImage label, title, leftTitle, rightTitle;   // static parts of the final output
+int outputLevel=OUTPUT_FINAL;
+int trackFace=1;          // segment only around the previous face box
+int redetectInterval=16;  // search the full frame at least this often; frames are analyzed in chunks of this size
+int numWorkers=0;         // analysis threads, 0 = one per core
+int queueSize=8;          // capacity of the decode and write queues
+int prefetchFrames=4;     // frames decoded ahead of the analysis
+int numEncoders=2;        // JPEG encoder threads of a session
+int videoOutput=1;        // write finalOutput as one MJPEG AVI instead of a JPEG per frame
+int videoRate=30;         // frames per second of that AVI
+int tracing=0;            // time the stages of every frame
+int faceScale=2;          // the face is searched on the frame reduced 1, 2 or 4 times
+int staticThreshold=2;    // gray levels an 8x8 block of the face may change by and the frame still reuse the last analysis, 0 = analyze every frame
+int tileThreads=0;        // threads that share the masks of each frame in row bands, and its two eyes, 0 = none
+TilePool * tilePool=NULL; // those threads, shared by every analysis thread
+int realtimeBudget=0;     // ms from the capture of a frame to its commit in the real-time driver, 0 = every frame is processed
+int roiDecode=0;          // with OUTPUT_RESULTS, JPEG frames are decoded by the analysis, only what it reads of them
+
+const char * presetNames[NUM_PRESETS] = { "Bright", "BrightNear", "Normal", "Controlled", "Uneven" };
+
+Session::~Session(){
+	delete tracer;
+	delete log;
+	for(size_t k=0; k<spareFrames.size(); k++)
+		delete spareFrames[k];
+}
+
+/* Function to get a frame to decode into, reusing the buffers of a written frame when there is one */
+FrameResult * takeFrame(Session & s){
+	std::lock_guard<std::mutex> lock(s.spareMutex);
+	FrameResult * result;
+	if(s.spareFrames.empty())
+		result = new FrameResult;
+	else{
+		result = s.spareFrames.back();
+		s.spareFrames.pop_back();
+	}
+	result->level = s.outputLevel;
+	return result;
+}
+
+/* Function to give a written frame back for reuse */
+void recycleFrame(Session & s, FrameResult * result){
+	if(s.tracer)
+		s.tracer->endFrame(result->index);
+	std::lock_guard<std::mutex> lock(s.spareMutex);
+	s.spareFrames.push_back(result);
+}
+
+/* Function to clear an eye image and its black pixel count */
+void clearEye(FrameResult & result, int eyeNum, int width, int height){
+	result.eyeCols[eyeNum] = width;
+	result.eyeRows[eyeNum] = height;
+	if(result.level>=OUTPUT_FINAL){
+		result.eye[eyeNum].resize(width, height);
+		result.eye[eyeNum].setAll(COLOR_RGB(255,255,255));
+	}
+	result.eyeBlack[eyeNum] = 0;
+	result.momentX[eyeNum] = result.momentY[eyeNum] = 0;
+}
+
+/* Function to paint a black pixel into an eye image and count it */
+void paintBlack(FrameResult & result, int eyeNum, int x, int y){
+	if(result.level>=OUTPUT_FINAL)
+		result.eye[eyeNum](x,y) = COLOR_RGB(0,0,0);
+	result.eyeBlack[eyeNum]++;
+	result.momentX[eyeNum] += x;
+	result.momentY[eyeNum] += y;
+}
+
+/* Function for scaling images */
+void scaleRGB( RGBImage & outputImage, const RGBImage & inputImage) {
+	int xTarget,yTarget,xSource,ySource;
+	int width = inputImage.width();
+	int height = inputImage.height();
+	int  targetWidth = width*3;
+	int targetHeight = height*3;
+  
+	outputImage.resize(targetWidth,targetHeight);
+
+	for (xTarget = 0; xTarget < targetWidth; xTarget++) {
+		for (yTarget = 0; yTarget < targetHeight; yTarget++) {
+			xSource = xTarget * width / targetWidth;
+			ySource = yTarget * height / targetHeight;
+			outputImage(xTarget,yTarget) = inputImage(xSource,ySource);
+		}
+	}
+}
+
+/* Function for coloring boxes in eye direction */
+void colorEyeDirection(RGBImage & eyeDirection, int startWidth, int endWidth, int startHeight, int endHeight, int render){
+	int x,y;
+	if(!render)
+		return;
+	for(x=startWidth; x<endWidth; x++){
+		for(y=startHeight; y<endHeight; y++){
+			eyeDirection(x,y) = COLOR_RGB(0,128,0);
+		}
+	}
+}
+
+/* Function to get the level of a frame on the graph from the direction of its selected eye */
+int graphLevel(const GazeRecord & record){
+	if(record.cell==CELL_NONE)
+		return 20;                         // blink
+	if(record.cell%3==0)
+		return 80;                         // left
+	if(record.cell%3==1)
+		return 60;                         // center
+	return 40;                             // right
+}
+
+/* Function to draw a frame into the columns x, x+1 of a graph: the change from the level of the frame before, then its own */
+void drawGraph(RGBImage & graph, int x, int startY, const GazeRecord & record){
+	int y = graphLevel(record);
+	int x1;
+	
+	/* the columns of this frame may still hold a frame from one turn of the ring ago */
+	for(x1=x; x1<=x+1; x1++)
+		for(int y1=0; y1<graph.height(); y1++)
+			graph(x1,y1)=COLOR_RGB(0,0,0);
+	
+	/* to change from one direction to another */
+	if(y>startY){		
+		for(int y1=startY+1; y1<=y; y1++)			
+			graph(x,y1)=COLOR_RGB(255,128,0);
+	}
+	else{
+		for(int y1=y+1; y1<=startY; y1++)			
+			graph(x,y1)=COLOR_RGB(255,128,0);
+	}
+	if(record.cell==CELL_NONE){
+		for(x1=x; x1<=x+1; x1++)
+			graph(x1,y)=COLOR_RGB(0,255,0);
+	}
+	else{
+		for(x1=x; x1<=x+1; x1++)
+			graph(x1,y)=COLOR_RGB(255,128,0);
+	}	
+}
+
+/* Function to mark the center of mass of the black pixels, given their count and moments */
+void centerOfMass(Session & s, RGBImage & eye, int counterBlack, long momentx, long momenty, int render){ 
+	int x, y;
+	
+	s.centerx = (int)(momentx/counterBlack);
+	s.centery = (int)(momenty/counterBlack);
+	if(!render)
+		return;
+	
+	for(x=s.centerx-1; x<=s.centerx+1; x++){
+		for(y=s.centery-1; y<=s.centery+1; y++){
+			eye(x, y) = COLOR_RGB(0, 0, 255);
+		}
+	}
+}
+
+/* Function to determine the movement or blink of the eye; returns its GazeCell. With render, the eye and its direction are drawn */
+int eyeMovement(Session & s, RGBImage & eye, RGBImage & eyeDirection, int width, int height, int i, int eyeNum, int realEyeNum, int eyeBlack, long momentX, long momentY, int render){
+	int x, y;
+	int box1, box2, box3, box4;
+	box1=box2=box3=box4=0;
+	StageTimer timer(STAGE_DIRECTION);
+	s.leftFlag = s.centerFlag = s.rightFlag = s.blinkFlag = 0;
+	int cell = CELL_NONE;
+	int adjust=((width/3)/5);
+	
+	if(render){
+		eyeDirection.resize(boxWidth, boxHeight);
+		eyeDirection.setAll(COLOR_RGB(255,255,255));
+		
+		// draw 9 boxes
+		for (x = 0; x < boxWidth;  x++){
+			for (y=0; y<3; y++){
+				eyeDirection(x, y+boxHeight/3) = COLOR_RGB(255,0,0);
+				eyeDirection(x, y+boxHeight-boxHeight/3) = COLOR_RGB(255,0,0);
+			}
+		}
+		for(x=0;x<3;x++){
+			for (y = 0; y < boxHeight; y++){
+				eyeDirection(x+boxWidth/3, y) = COLOR_RGB(255,0,0);
+				eyeDirection(x+boxWidth-boxWidth/3, y) = COLOR_RGB(255,0,0);
+			}
+		}
+	}
+	// blink
+	if(eyeBlack <= s.overAllBlack/6){
+		s.blinkFlag=1;
+		if(realEyeNum==2) s.blink++;
+		for(x=(boxWidth/3)+3; render && x<2*(boxWidth/3); x++){
+			for(y=(boxHeight/3)+3; y<2*(boxHeight/3); y++){
+				eyeDirection(x,y) = COLOR_RGB(128,0,0);
+			}
+		}		
+	} 
+	else{ 
+		centerOfMass(s, eye, eyeBlack, momentX, momentY, render); 
+			/* Upper Left */
+			if(s.centerx<width/3 + adjust -s.centerAdjust && s.centery<(height/3)){	
+				s.leftFlag=1;
+				colorEyeDirection(eyeDirection,0,boxWidth/3,0,boxHeight/3, render);	
+				cell = CELL_UPPER_LEFT;
+				if(realEyeNum==2) s.upperLeft++;
+			}
+			/* Left */
+			else if(s.centerx<width/3 + adjust - s.centerAdjust && s.centery>=height/3&& s.centery<=2*(height/3)){
+				s.leftFlag=1;
+				colorEyeDirection(eyeDirection,0,boxWidth/3,3+boxHeight/3,2*(boxHeight/3), render);	
+				cell = CELL_LEFT;
+				if(realEyeNum==2) s.left++;
+			}
+			/* Lower Left */
+			else if(s.centerx<width/3 + adjust - s.centerAdjust && s.centery>2*(height/3)){ 
+				s.leftFlag=1;
+				colorEyeDirection(eyeDirection,0,boxWidth/3,3+2*(boxHeight/3),boxHeight, render);
+				cell = CELL_LOWER_LEFT;
+				if(realEyeNum==2) s.lowerLeft++; 
+			}
+			/* Top */
+			else if(s.centerx>=width/3 + adjust - s.centerAdjust && s.centerx<2*(width/3) -adjust && s.centery<height/3){ 
+				s.centerFlag=1;
+				colorEyeDirection(eyeDirection,3+boxWidth/3,2*(boxWidth/3),0,boxHeight/3, render);
+				cell = CELL_UP;
+				if(realEyeNum==2) s.up++;
+			}
+			/* Center */
+			else if((s.centerx>=width/3 + adjust - s.centerAdjust) && (s.centerx<2*(width/3) - adjust) && s.centery>=height/3 && s.centery<=2*(height/3)){ 
+				s.centerFlag=1;
+				colorEyeDirection(eyeDirection,3+boxWidth/3,2*(boxWidth/3),3+boxHeight/3,2*(boxHeight/3), render);
+				cell = CELL_CENTER;
+				if(realEyeNum==2) s.center++;
+			}
+			/* Bottom */
+			else if(s.centerx>=width/3 + adjust - s.centerAdjust && s.centerx<2*(width/3) - adjust && s.centery>2*(height/3)){
+				s.centerFlag=1;
+				colorEyeDirection(eyeDirection,3+boxWidth/3,2*(boxWidth/3),3+2*(boxHeight/3),boxHeight, render);
+				cell = CELL_LOW;
+				if(realEyeNum==2) s.low++;
+			}
+			/* Upper Right */
+			else if(s.centerx>=2*(width/3) - adjust && s.centery<height/3){
+				s.rightFlag=1;
+				colorEyeDirection(eyeDirection,3+2*(boxWidth/3),boxWidth,0,boxHeight/3, render);
+				cell = CELL_UPPER_RIGHT;
+				if(realEyeNum==2) s.upperRight++;
+			}
+			/* Right */
+			else if(s.centerx>=2*(width/3) - adjust && s.centery>=height/3 && s.centery<=2*(height/3)){ 
+				s.rightFlag=1;
+				colorEyeDirection(eyeDirection,3+2*(boxWidth/3),boxWidth,3+boxHeight/3,2*(boxHeight/3), render);
+				cell = CELL_RIGHT;
+				if(realEyeNum==2) s.right++;
+			}
+			/* Lower Right */
+			else if(s.centerx>=2*(width/3) - adjust && s.centery>2*(height/3)){ 
+				s.rightFlag=1;
+				colorEyeDirection(eyeDirection,3+2*(boxWidth/3),boxWidth,3+2*(boxHeight/3),boxHeight, render);
+				cell = CELL_LOWER_RIGHT;
+				if(realEyeNum==2) s.lowerRight++;
+			}
+			else{  // Center
+				s.centerFlag=1;
+				colorEyeDirection(eyeDirection,3+boxWidth/3,2*(boxWidth/3),3+boxHeight/3,2*(boxHeight/3), render);
+				cell = CELL_CENTER;
+				if(realEyeNum==2) s.center++;
+			}
+	}
+	if(!render)
+		return cell;
+	for (x = 0; x < width;  x++){
+		eye(x, height/3) = COLOR_RGB(255,0,0);
+		eye(x, height-height/3) = COLOR_RGB(255,0,0);
+		
+	}				
+	for (y = 0; y < height; y++){
+		eye(width/3 + adjust - s.centerAdjust, y) = COLOR_RGB(255,0,0);
+		eye(width-width/3- adjust, y) = COLOR_RGB(255,0,0);
+	}
+	return cell;
+}
+
+/* Function to render the pixels of a mask in the columns [x0,x1) black on white */
+void renderMask(RGBImage & sample, const BitMask & binary, int x0, int x1){
+	sample.resize(binary.width(), binary.height());
+	sample.setAll(COLOR_RGB(255,255,255));
+	for (int x = x0; x < x1;  x++) {
+		for (int y = 0; y < binary.height(); y++) {
+			if(binary(x,y))
+				sample(x,y) = COLOR_RGB(0,0,0);
+		}
+	}
+}
+
+#define MIN_BAND_ROWS 16   // fewest rows of a band on the tile pool
+
+/*
+    Function to call task(band, y0, y1) for the row bands of height rows on the tile pool, or NULL; returns the
+    number of bands. The task is called directly when there is one band, and otherwise handed to the pool
+    through a TilePool::Task that holds only a reference to it, small enough for std::function to keep
+    without allocating, so the bands of a frame do not allocate either way.
+*/
+template <class BandTask>
+int forBands(TilePool * tilePool, std::vector<BandScratch> & bands, int height, int minRows, const BandTask & task){
+	int n = TilePool::bandRows(tilePool, height, minRows);
+	
+	if((int)bands.size()<n)
+		bands.resize(n);
+	if(n==1){
+		task(bands[0], 0, height);
+		return 1;
+	}
+	auto band = [&](int b){
+		int y0, y1;
+		TilePool::bandRange(height, n, b, y0, y1);
+		task(bands[b], y0, y1);
+	};
+	tilePool->run(n, TilePool::Task([&band](int b){ band(b); }));
+	return n;
+}
+
+/*
+    Function to filter a mask with ops in row bands on the tile pool. A band filters a copy of its rows
+    and of halo rows above and below them, as many as the filters reach together, so the rows it keeps
+    see the same windows as in the whole mask and the result does not depend on the number of bands.
+*/
+template <class MorphologyOps>
+void bandMorphology(TilePool * tilePool, std::vector<BandScratch> & bands, BitMask & mask, int halo, const MorphologyOps & ops){
+	int height = mask.height(), words = mask.wordsPerRow();
+	int minRows = std::max(MIN_BAND_ROWS, 2*halo);   // at most as many halo rows as rows kept
+	
+	if(TilePool::bandRows(tilePool, height, minRows)==1 || words==0){
+		if(bands.empty())
+			bands.resize(1);
+		ops(bands[0].morph, mask);
+		return;
+	}
+	int n = forBands(tilePool, bands, height, minRows, [&](BandScratch & band, int y0, int y1){
+		int a = std::max(0, y0-halo), b = std::min(height, y1+halo);
+		band.mask.resize(mask.width(), b-a);
+		std::copy(mask.row(a), mask.row(a)+(size_t)(b-a)*words, band.mask.row(0));
+		ops(band.morph, band.mask);
+	});
+	// the bands read the halos from the mask, so their rows go back only once all are done
+	for(int k=0; k<n; k++){
+		int y0, y1;
+		TilePool::bandRange(height, n, k, y0, y1);
+		const uint64_t * rows = bands[k].mask.row(y0-std::max(0, y0-halo));
+		std::copy(rows, rows+(size_t)(y1-y0)*words, mask.row(y0));
+	}
+}
+
+/* Function to compute the gray image and its median over the whole band of each eye, for the presets of a sweep */
+void prepareEyeBands(FrameScratch & scratch, RGBImage & inputImage, int startRow2X, int startRow2Y, int w, int h){
+	const ColorKernels & kernels = colorKernels();
+	
+	for(int eyeNum=0; eyeNum<2; eyeNum++){
+		Plane<unsigned char> & gray = scratch.bandGray[eyeNum];
+		int eyeRegion = eyeNum==0 ? 0 : w/2;
+		
+		gray.resize( w/2, h+h/2 );
+		{
+			StageTimer timer(STAGE_IRIS);
+			for (int y = 0; y < h+h/2; y++)
+				kernels.grayRow(rowOf(inputImage, startRow2X+eyeRegion, startRow2Y+h+y), w/2, &gray(0,y));
+		}
+		StageTimer timer(STAGE_MEDIAN);
+		percentileFilter( gray, scratch.bandMedian[eyeNum], 9, 50 );
+	}
+}
+
+/*
+    Function to get the median of an eye band as searched by one preset, the columns [x0,x1), from the
+    median of the whole band. A preset sees 0 outside its columns, so only the columns whose window
+    reaches outside them differ, and only those are filtered again.
+*/
+void presetMedian(FrameScratch & scratch, int eyeNum, int x0, int x1, int filterWidth){
+	Plane<unsigned char> & band = scratch.bandGray[eyeNum];
+	Plane<unsigned char> & grayImage = scratch.eyes[eyeNum].gray, & grayMedian = scratch.eyes[eyeNum].median;
+	int r = filterWidth/2;
+	
+	grayImage.resize(band.width(), band.height());
+	grayImage.setAll(0);
+	grayMedian = scratch.bandMedian[eyeNum];
+	if(x0>=x1)
+		return;
+	for(int y=0; y<band.height(); y++)
+		memcpy(&grayImage(x0,y), &band(x0,y), x1-x0);
+	percentileFilterColumns(grayImage, grayMedian, filterWidth, 50, x0, std::min(x1, x0+r));
+	percentileFilterColumns(grayImage, grayMedian, filterWidth, 50, std::max(x0+r, x1-r), x1);
+}
+
+/* What the iris search of an eye leaves to the search of its boundary */
+struct IrisSearch {
+	int notBlink;
+	int found;                                     // an iris inside the margins was found
+	int pupilX, pupilY, pupilWidth, pupilHeight;   // the largest of them, in the region of the eye
+};
+
+/* Function to search the iris of one eye: median, threshold and closing of the band below the eyebrows */
+void searchIris(Session & s, FrameScratch & frameScratch, int eyeNum, RGBImage & inputImage, FrameResult & result, int startRow2X, int startRow2Y, int w, int h, IrisSearch & iris){
+	char medianFile[300];
+	int eyeRegionStart, eyeRegionEnd, eyeRegion;
+	int x, y, startX, startY, c;
+	
+	EyeScratch & scratch = frameScratch.eyes[eyeNum];
+	BitMask & binary = scratch.binary;   // bit-packed mask
+	Plane<unsigned char> & grayImage = scratch.gray, & grayMedian = scratch.median;
+	const ColorKernels & kernels = colorKernels();
+	int irisLimit = grayLimit(s.irisThreshold);     // threshold on gray values
+	ComponentLabeller & cc = scratch.cc;       // connected component labelling
+	int filterWidth = 9;     // the width of the filter
+	int strucWidth = 11;
+	
+	sprintf(medianFile, "%s/median/median.jpg", s.outputPath);
+	
+	clearEye(result, eyeNum, 50, 15);
+	result.notBlink[eyeNum] = result.eyeFound[eyeNum] = 0;
+	result.pupilHeight[eyeNum] = result.eyeHeight[eyeNum] = result.pupilBlack[eyeNum] = 0;
+	for(int k=0; k<4; k++)
+		result.pupilBox[eyeNum][k] = result.eyeBox[eyeNum][k] = 0;
+	iris.notBlink = iris.found = 0;
+	iris.pupilX = iris.pupilY = iris.pupilWidth = iris.pupilHeight = 0;
+	
+	/* left or right eye? */
+	if(eyeNum==0){		
+		eyeRegion=0;
+		eyeRegionStart = s.MARGIN;
+		eyeRegionEnd = 0;
+	}
+	else{
+		eyeRegion=w/2;
+		eyeRegionStart =0;
+		eyeRegionEnd = s.MARGIN;
+	}
+	
+	// create a binary image using thresholding
+	binary.resize( w/2, h+h/2 );
+	binary.setAll( 0 );
+	grayImage.resize( w/2,h+h/2 );  
+	grayImage.setAll( 0 );     // the median also reads the columns outside the searched region
+	
+	int regionWidth = w/2-eyeRegionEnd-eyeRegionStart;   // columns of the region that are searched
+	
+	/* iris */
+	if(frameScratch.sharedBands){
+		StageTimer timer(STAGE_MEDIAN);
+		presetMedian(frameScratch, eyeNum, eyeRegionStart, w/2-eyeRegionEnd, filterWidth);
+	}
+	else{
+		if(regionWidth>0){
+			StageTimer timer(STAGE_IRIS);
+			forBands(s.tilePool, scratch.bands, h+h/2, MIN_BAND_ROWS, [&](BandScratch &, int y0, int y1){
+				for (int y = y0; y < y1; y++)
+					kernels.grayRow(rowOf(inputImage, startRow2X+eyeRegionStart+eyeRegion, startRow2Y+h+y), regionWidth, &grayImage(eyeRegionStart,y));
+			});
+		}
+		
+		StageTimer timer(STAGE_MEDIAN);
+		grayMedian.resize( w/2, h+h/2 );
+		forBands(s.tilePool, scratch.bands, h+h/2, MIN_BAND_ROWS, [&](BandScratch &, int y0, int y1){
+			percentileFilterBlock( grayImage, grayMedian, filterWidth, 50, 0, w/2, y0, y1 );   // median
+		});
+	}
+	
+	// HSI intensity of the median below irisThreshold
+	if(regionWidth>0){
+		StageTimer timer(STAGE_IRIS);
+		forBands(s.tilePool, scratch.bands, h+h/2, MIN_BAND_ROWS, [&](BandScratch & band, int y0, int y1){
+			band.lineMask.resize(regionWidth);
+			for (int y = y0; y < y1; y++){
+				kernels.lessThanRow(&grayMedian(eyeRegionStart,y), regionWidth, irisLimit, &band.lineMask[0]);
+				binary.setRow(y, eyeRegionStart, &band.lineMask[0], regionWidth);
+			}
+		});
+	}
+	// closing with a square structuring element
+	{
+		StageTimer timer(STAGE_MORPHOLOGY);
+		bandMorphology(s.tilePool, scratch.bands, binary, 2*(strucWidth/2), [&](RectMorphology & morph, BitMask & mask){
+			morph.close( mask, mask, strucWidth, strucWidth, strucWidth/2, strucWidth/2 );
+		});
+	}
+	
+	if(binary.count(eyeRegionStart, w/2-eyeRegionEnd))
+		iris.notBlink = 1;
+	if(result.level==OUTPUT_DEBUG){
+		renderMask(frameScratch.sample, binary, eyeRegionStart, w/2-eyeRegionEnd);
+		writeJpeg(frameScratch.sample, medianFile, 100);
+	}
+	if(!iris.notBlink)
+		return;
+	
+	int _maxPupilWidth=0, _maxPupilHeight=0, _maxPupilX=0, _maxPupilY=0;
+	int ROI = (w/2)*(h+h/2);
+	int minimumArea = ROI/180; // range of size of objects to be considered
+	int maximumArea = ROI/40;  // 25
+	
+	StageTimer ccTimer(STAGE_COMPONENTS);
+	cc.analyzeBinary( binary, EIGHT_CONNECTED );	
+	
+	for(c = 0; c < cc.getNumComponents(); c++){ 
+		int ch, cw;
+		int numPix = cc.getStats(c).area;
+				
+		// if the size of the object is within the specified range
+		if (minimumArea < numPix && numPix < maximumArea) {	
+			cc.getBoundary(c,startX,startY,cw,ch);
+			
+			if((startX>s.MARGIN && startX+cw<w-s.MARGIN) && (startY-5>0 && startY+ch<h+h/2)){
+				if(_maxPupilWidth*_maxPupilHeight<cw*ch){ 
+					_maxPupilX = startX;
+					_maxPupilY = startY;
+					_maxPupilWidth = cw;
+					_maxPupilHeight = ch;
+				}
+				iris.found=1;
+			}	
+		}
+		else{ 
+			clearEye(result, eyeNum, 50, 15);
+			for(x=20; x<=s.MARGIN; x++){
+				for(y=5; y<=10; y++){
+					paintBlack(result, eyeNum, x, y);
+				}
+			}
+		}
+	}
+	
+	ccTimer.stop();
+	result.area[eyeNum] = _maxPupilWidth*_maxPupilHeight;
+	if(result.area[eyeNum]){
+		int * box = result.pupilBox[eyeNum];
+		box[0] = startRow2X+_maxPupilX+eyeRegion;
+		box[1] = startRow2Y+_maxPupilY+h;
+		box[2] = _maxPupilWidth;
+		box[3] = _maxPupilHeight;
+	}
+	result.notBlink[eyeNum] = 1;
+	result.pupilHeight[eyeNum] = _maxPupilHeight;
+	iris.pupilX = _maxPupilX;
+	iris.pupilY = _maxPupilY;
+	iris.pupilWidth = _maxPupilWidth;
+	iris.pupilHeight = _maxPupilHeight;
+}
+
+/*
+    Function to search the boundary of one eye below its iris and paint the pupil into the eye image.
+    irisFlag and maxPupilY are what the search of the eyes in turn had kept so far: an iris of either
+    eye, and the top of the last largest pupil.
+*/
+void searchEyeBoundary(Session & s, FrameScratch & frameScratch, int eyeNum, RGBImage & inputImage, FrameResult & result, int startRow2X, int startRow2Y, int w, int h,
+                       const IrisSearch & iris, int irisFlag, int maxPupilY){
+	char medianFile[300], eyeFile[300];
+	int eyeRegionStart, eyeRegionEnd, eyeRegion;
+	int x, y, startX, startY, c;
+	
+	RGBImage & eye = result.eye[eyeNum];
+	EyeScratch & scratch = frameScratch.eyes[eyeNum];
+	BitMask & binary1 = scratch.binary1;
+	const ColorKernels & kernels = colorKernels();
+	int eyeLimit = intensityLimit(s.eyeThreshold);  // threshold on r+g+b sums
+	RGBImage & sample = frameScratch.sample;
+	ComponentLabeller & cc = scratch.cc;
+	int strucWidth = 11;
+	
+	if(!iris.notBlink || !irisFlag){  // blink
+		clearEye(result, eyeNum, 50, 15);
+		return;
+	}
+	
+	sprintf(medianFile, "%s/median/median.jpg", s.outputPath);
+	sprintf(eyeFile, "%s/median/eye.jpg", s.outputPath);
+	if(eyeNum==0){		
+		eyeRegion=0;
+		eyeRegionStart = s.MARGIN;
+		eyeRegionEnd = 0;
+	}
+	else{
+		eyeRegion=w/2;
+		eyeRegionStart =0;
+		eyeRegionEnd = s.MARGIN;
+	}
+	int regionWidth = w/2-eyeRegionEnd-eyeRegionStart;
+	int _maxPupilWidth = iris.pupilWidth, _maxPupilHeight = iris.pupilHeight, _maxPupilX = iris.pupilX, _maxPupilY = iris.pupilY;
+	int _eyeStartX=0, _eyeStartY=0, _eyeWidth=0, _eyeHeight=0;
+	int ROI = (w/2)*(h+h/2);
+	int ch, cw;
+	
+	/* Eye boundary */
+	binary1.resize( w/2, h+h/2 );
+	binary1.setAll(0);
+	
+	if(maxPupilY-5>0){
+		// HSI intensity below eyeThreshold
+		if(regionWidth>0){
+			StageTimer timer(STAGE_EYE_BOUNDARY);
+			int top = maxPupilY-5;
+			forBands(s.tilePool, scratch.bands, h+h/2-top, MIN_BAND_ROWS, [&](BandScratch & band, int y0, int y1){
+				band.lineMask.resize(regionWidth);
+				for (int y = top+y0; y < top+y1; y++){
+					kernels.intensityMaskRow(rowOf(inputImage, startRow2X+eyeRegionStart+eyeRegion, startRow2Y+h+y), regionWidth, eyeLimit, &band.lineMask[0]);
+					binary1.setRow(y, eyeRegionStart, &band.lineMask[0], regionWidth);
+				}
+			});
+		}
+		
+		{
+			StageTimer timer(STAGE_MORPHOLOGY);
+			bandMorphology(s.tilePool, scratch.bands, binary1, 2*(strucWidth/2), [&](RectMorphology & morph, BitMask & mask){
+				morph.close( mask, mask, strucWidth, strucWidth, strucWidth/2, strucWidth/2 );
+			});
+		}
+		
+	
+		int minimumArea = ROI/68;
+		int maximumArea = ROI/10; 
+	
+		if(result.level==OUTPUT_DEBUG){
+			renderMask(sample, binary1, eyeRegionStart, w/2-eyeRegionEnd);
+			writeJpeg(sample, medianFile, 100);
+		}
+	
+		StageTimer eyeCCTimer(STAGE_COMPONENTS);
+		cc.analyzeBinary( binary1, EIGHT_CONNECTED );
+	
+		for(c = 0; c < cc.getNumComponents(); c++){
+			int numPix = cc.getStats(c).area;
+			// if the size of the object is within the specified range
+			if (minimumArea <= numPix && numPix <= maximumArea) { 
+				cc.getBoundary(c,startX,startY,cw,ch);
+				if(startY-5>0){
+					if(_eyeWidth*_eyeHeight < cw*ch){
+						_eyeStartX = startX;
+						_eyeStartY = startY;
+						_eyeWidth = cw;
+						_eyeHeight = ch;
+					}
+				}
+			}
+		}
+		eyeCCTimer.stop();
+		
+		if(_eyeWidth==0 || _eyeHeight==0){
+			clearEye(result, eyeNum, 50, 15);
+			for(x=20; x<=s.MARGIN; x++){
+				for(y=5; y<=10; y++){
+					paintBlack(result, eyeNum, x, y);
+				}
+			}
+		}
+		else{
+			clearEye(result, eyeNum, _eyeWidth, _eyeHeight);
+			
+			if(result.level==OUTPUT_DEBUG){
+				renderMask(sample, binary1, eyeRegionStart, w/2-eyeRegionEnd);
+				writeJpeg(sample, medianFile, 100);
+			}
+			if(abs(_maxPupilX-_eyeStartX)<_eyeWidth && abs(maxPupilY-_eyeStartY)<_eyeHeight){
+				for (x = abs(_maxPupilX-_eyeStartX); x < abs(_maxPupilX-_eyeStartX+_maxPupilWidth);  x++){
+					for (y = abs(_maxPupilY-_eyeStartY); y < abs(_maxPupilY-_eyeStartY+_maxPupilHeight); y++){
+						paintBlack(result, eyeNum, x, y);
+						result.pupilBlack[eyeNum]++;
+					}	
+				}
+			}
+			result.eyeFound[eyeNum] = 1;
+			result.eyeHeight[eyeNum] = _eyeHeight;
+			int * box = result.eyeBox[eyeNum];
+			box[0] = startRow2X+_eyeStartX+eyeRegion;
+			box[1] = startRow2Y+_eyeStartY+h;
+			box[2] = _eyeWidth;
+			box[3] = _eyeHeight;
+			if(result.level==OUTPUT_DEBUG)
+				writeJpeg(eye, eyeFile, 100);
+		}
+	}
+	else{
+		clearEye(result, eyeNum, 50, 15);
+		for(x=20; x<=s.MARGIN; x++){
+			for(y=5; y<=10; y++){
+				paintBlack(result, eyeNum, x, y);
+			}
+		}
+	}
+}
+
+/* Function to draw the outline of a box: x, y, width, height; the right and bottom lines are just outside it */
+void drawBox(RGBImage & image, const int box[4], unsigned int color){
+	for (int x = box[0]; x < box[0]+box[2];  x++) {
+		image(x,box[1]) = color;           // top
+		image(x,box[1]+box[3]) = color;    // bottom
+	}
+	for (int y = box[1]; y < box[1]+box[3]; y++) {
+		image(box[0],y) = color;           // left
+		image(box[0]+box[2],y) = color;    // right
+	}
+}
+
+/*
+    Function to detect the eyes.
+    Each eye is searched in two steps, its iris and then its boundary. The boundary of an eye is
+    searched whenever either eye has an iris so far, below the largest pupil of the last eye that
+    has one, so eye 1 may use the iris of eye 0; with a tile pool the irises of both eyes are searched
+    concurrently, then their boundaries. The boxes meet at the middle line of the face and are drawn
+    afterwards, eye 0 first.
+*/
+void detectEye(Session & s, FrameScratch & scratch, RGBImage & inputImage, RGBImage & outputImage, FrameResult & result, int startRow2X, int startRow2Y, int w, int h){
+	IrisSearch iris[2];
+	TraceContext trace = traceContext();
+	
+	result.area[0] = result.area[1] = 0;
+	
+	auto searchIrises = [&](int eyeNum){
+		TraceFrame context(trace.tracer, trace.frame);
+		searchIris(s, scratch, eyeNum, inputImage, result, startRow2X, startRow2Y, w, h, iris[eyeNum]);
+	};
+	auto searchBoundaries = [&](int eyeNum){
+		TraceFrame context(trace.tracer, trace.frame);
+		int later = eyeNum==1 && iris[1].found;
+		searchEyeBoundary(s, scratch, eyeNum, inputImage, result, startRow2X, startRow2Y, w, h, iris[eyeNum],
+			iris[0].found || later, later ? iris[1].pupilY : iris[0].pupilY);
+	};
+	
+	if(s.tilePool && result.level!=OUTPUT_DEBUG){   // the debug masks of both eyes go to the same files
+		s.tilePool->run(2, TilePool::Task([&searchIrises](int eyeNum){ searchIrises(eyeNum); }));
+		s.tilePool->run(2, TilePool::Task([&searchBoundaries](int eyeNum){ searchBoundaries(eyeNum); }));
+	}
+	else{
+		for(int eyeNum=0; eyeNum<2; eyeNum++){
+			searchIrises(eyeNum);
+			searchBoundaries(eyeNum);
+		}
+	}
+	
+	for(int eyeNum=0; result.level>=OUTPUT_FINAL && eyeNum<2; eyeNum++){
+		drawBox(outputImage, result.pupilBox[eyeNum], COLOR_RGB(0,255,0));
+		drawBox(outputImage, result.eyeBox[eyeNum], COLOR_RGB(0,0,255));
+	}
+}
+
+/* Function to fill the log record of an eye of a frame */
+void logRecord(GazeRecord & record, FrameResult & result, int eyeNum, int cell, int centerX, int centerY){
+	memset(&record, 0, sizeof(record));
+	record.frame = result.index;
+	record.black = result.eyeBlack[eyeNum];
+	record.centerX = cell==CELL_NONE ? -1 : centerX;
+	record.centerY = cell==CELL_NONE ? -1 : centerY;
+	for(int k=0; k<4; k++){
+		record.pupil[k] = result.pupilBox[eyeNum][k];
+		record.eye[k] = result.eyeBox[eyeNum][k];
+	}
+	record.eyeNum = eyeNum;
+	record.cell = cell;
+	record.flags = (cell==CELL_NONE ? GAZE_BLINK : 0) | (result.isStatic ? GAZE_STATIC : 0)
+		| (result.notBlink[eyeNum] ? GAZE_IRIS : 0) | (result.eyeFound[eyeNum] ? GAZE_EYE : 0);
+}
+
+/* Function to apply a frame in frame order: blink calibration, direction classification, the log and the graph */
+void commitFrame(Session & s, FrameResult & result){
+	int eyeNum, sel, cell;
+	RGBImage & eye = s.eyeOverlay;
+	GazeRecord records[2];
+	TraceFrame context(s.tracer, result.index);
+	
+	s.frames++;
+	if(result.isStatic)
+		s.staticFrames++;
+	s.leftFlag=s.rightFlag=s.centerFlag=s.blinkFlag=0;
+	for(eyeNum=0; eyeNum<2; eyeNum++){
+		if(result.notBlink[eyeNum]){
+			if(s.flag==0)
+				s.firstMaxPupilHeight[0] = result.pupilHeight[eyeNum];
+			else if(s.flag==1)
+				s.firstMaxPupilHeight[1] = result.pupilHeight[eyeNum];
+		}
+		// the first two eyes found give the pupil size of an open eye
+		if(result.eyeFound[eyeNum]){
+			if(s.flag==0 || s.flag==1)
+				s.overAllBlack += result.pupilBlack[eyeNum];
+			if(s.flag==0){
+				s.firstEyeHeight[0] = result.eyeHeight[eyeNum];
+			}
+			if(s.flag==1){
+				s.firstEyeHeight[1] = result.eyeHeight[eyeNum];
+			}
+			s.flag++;
+			if(s.flag==2){
+				s.overAllBlack = s.overAllBlack/2;
+			}
+		}
+		
+		// the direction of each eye, for the log and the overlay of each eye
+		if(result.level>=OUTPUT_FINAL)
+			eye = result.eye[eyeNum];  // eyeMovement draws on its argument
+		cell = eyeMovement(s, eye, result.eyeDirection[eyeNum], result.eyeCols[eyeNum], result.eyeRows[eyeNum], result.index, eyeNum, eyeNum, result.eyeBlack[eyeNum], result.momentX[eyeNum], result.momentY[eyeNum], result.level>=OUTPUT_FINAL);
+		logRecord(records[eyeNum], result, eyeNum, cell, s.centerx, s.centery);
+		if(result.level>=OUTPUT_FINAL)
+			scaleRGB(result.eyeResized[eyeNum], eye);
+	}
+	if(s.outputLevel==OUTPUT_DEBUG)
+		printf("\n%d", eyeNum);
+	
+	/* classify again using the eye with the larger pupil, this time counting the result; its overlay is drawn above */
+	sel = result.area[0]>result.area[1] ? 0 : 1;
+	cell = eyeMovement(s, result.eye[sel], result.eyeDirection[sel], result.eyeCols[sel], result.eyeRows[sel], result.index, sel, eyeNum, result.eyeBlack[sel], result.momentX[sel], result.momentY[sel], 0);
+	records[sel].flags |= GAZE_SELECTED;
+	records[sel].cell = cell;
+	if(s.log)
+		s.log->append(records, 2);
+	
+	/* the graph is rendered from the log record of the selected eye, also for a frame whose own output was reduced */
+	if(s.outputLevel>=OUTPUT_FINAL)
+		drawGraph(s.graph, s.graphX, s.previousY, records[sel]);
+	s.previousY = graphLevel(records[sel]);
+	s.graphX = s.graphX+2;
+	if(s.graphX >= s.graph.width()){
+		s.graphX = 0;
+		s.graphFull = 1;
+	}
+}
+
+/* Function to make sure the region [x0,x1)x[y0,y1) of a frame read compressed is decoded; what was decoded before is decoded again with it */
+void decodeRegion(FrameResult & result, int x0, int y0, int x1, int y1){
+	int * d = result.decoded;
+	
+	if(result.jpeg.empty())
+		return;
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, result.inputImage.width());
+	y1 = std::min(y1, result.inputImage.height());
+	if(x0>=x1 || y0>=y1 || (x0>=d[0] && y0>=d[1] && x1<=d[2] && y1<=d[3]))
+		return;
+	if(d[0]<d[2]){
+		x0 = std::min(x0, d[0]);
+		y0 = std::min(y0, d[1]);
+		x1 = std::max(x1, d[2]);
+		y1 = std::max(y1, d[3]);
+	}
+	StageTimer timer(STAGE_DECODE);
+	if(decodeJpeg(result.jpeg, result.inputImage, 1, x0, y0, x1, y1)){
+		d[0] = x0;
+		d[1] = y0;
+		d[2] = x1;
+		d[3] = y1;
+	}
+}
+
+/* Function to decode the whole of a frame read compressed, faceScale times smaller, into its coarse image */
+int decodeCoarse(FrameResult & result){
+	StageTimer timer(STAGE_DECODE);
+	return decodeJpeg(result.jpeg, result.coarse, faceScale);
+}
+
+/*
+    Function to get the window searched for the face of a frame while the face of the previous frame is tracked.
+    It starts on the faceScale x faceScale block grid of the frame, so the window is reduced to the same
+    pixels as the whole frame is.
+*/
+void faceWindow(const FaceTrack & track, int width, int height, int & x0, int & y0, int & x1, int & y1){
+	x0 = std::max(0, track.x - track.w/4);
+	y0 = std::max(0, track.y - track.h/4);
+	x0 -= x0%faceScale;
+	y0 -= y0%faceScale;
+	x1 = std::min(width, track.x + track.w + track.w/4);
+	y1 = std::min(height, track.y + track.h + track.h/4);
+}
+
+/* Function to average the step x step blocks of n block columns, starting at (x0,y0), into packed pixels */
+void downsampleRow(RGBImage & inputImage, int x0, int y0, int step, int n, unsigned int * out){
+	for(int i=0; i<n; i++){
+		int r=0, g=0, b=0;
+		for(int dy=0; dy<step; dy++){
+			const unsigned int * row = rowOf(inputImage, x0+i*step, y0+dy);
+			for(int dx=0; dx<step; dx++){
+				r += RED(row[dx]);
+				g += GREEN(row[dx]);
+				b += BLUE(row[dx]);
+			}
+		}
+		out[i] = COLOR_RGB(r/(step*step), g/(step*step), b/(step*step));
+	}
+}
+
+/* Function to find the longest run of skin pixels of each full resolution line of a strip, along x (columns) or y (rows) */
+void skinRuns(FrameScratch & scratch, RGBImage & inputImage, int x0, int y0, int x1, int y1, const float scale[3], bool columns, std::vector<int> & longest){
+	const ColorKernels & kernels = colorKernels();
+	float max[3] = {0, 0, 0};
+	int n = x1-x0;
+	std::vector<int> & run = scratch.lineRun;   // length of the run ending at the current pixel of each column
+	
+	longest.assign(columns ? n : y1-y0, 0);
+	run.assign(n, 0);
+	scratch.lineY.resize(n);
+	scratch.lineCr.resize(n);
+	scratch.lineCb.resize(n);
+	scratch.lineMask.resize(n);
+	for(int y=y0; y<y1; y++){
+		kernels.ycrcbRow(rowOf(inputImage, x0, y), n, &scratch.lineY[0], &scratch.lineCr[0], &scratch.lineCb[0], max);
+		kernels.skinMaskRow(&scratch.lineY[0], &scratch.lineCr[0], &scratch.lineCb[0], n, scale, &scratch.lineMask[0]);
+		int rowRun = 0;
+		for(int x=0; x<n; x++){
+			if(columns){
+				run[x] = scratch.lineMask[x] ? run[x]+1 : 0;
+				longest[x] = std::max(longest[x], run[x]);
+			}
+			else{
+				rowRun = scratch.lineMask[x] ? rowRun+1 : 0;
+				longest[y-y0] = std::max(longest[y-y0], rowRun);
+			}
+		}
+	}
+}
+
+/*
+    Function to move the edges of a face box found at a reduced resolution to full resolution.
+    The morphology grows the mask by grow pixels past the skin, so each edge is searched in a
+    strip reaching that far inside the box: it is put at the outermost line that holds a run
+    as long as the structuring element, then moved out by grow again.
+*/
+void refineFaceBox(FrameScratch & scratch, RGBImage & inputImage, int x0, int y0, int x1, int y1, int step, int strucWidth,
+                   const float scale[3], int & startX, int & startY, int & w, int & h){
+	int grow = (2*strucWidth-1)/2 - strucWidth/2;
+	int reach = grow + 2*step;
+	int left = startX, top = startY, right = startX+w-1, bottom = startY+h-1;
+	int a, b, k;
+	std::vector<int> & longest = scratch.lineCount;   // longest skin run of each line
+	
+	// left and right edges, runs along the columns of the box
+	a = std::max(x0, left-step);
+	b = std::min(x1, left+reach+1);
+	if(a<b){
+		skinRuns(scratch, inputImage, a, top, b, bottom+1, scale, true, longest);
+		for(k=0; k<b-a && longest[k]<strucWidth; k++);
+		if(k<b-a) left = std::max(x0, a+k-grow);
+	}
+	a = std::max(x0, right-reach);
+	b = std::min(x1, right+step+1);
+	if(a<b){
+		skinRuns(scratch, inputImage, a, top, b, bottom+1, scale, true, longest);
+		for(k=b-a-1; k>=0 && longest[k]<strucWidth; k--);
+		if(k>=0) right = std::min(x1-1, a+k+grow);
+	}
+	
+	// top and bottom edges, runs along the rows between the new left and right
+	a = std::max(y0, top-step);
+	b = std::min(y1, top+reach+1);
+	if(a<b && left<=right){
+		skinRuns(scratch, inputImage, left, a, right+1, b, scale, false, longest);
+		for(k=0; k<b-a && longest[k]<strucWidth; k++);
+		if(k<b-a) top = std::max(y0, a+k-grow);
+	}
+	a = std::max(y0, bottom-reach);
+	b = std::min(y1, bottom+step+1);
+	if(a<b && left<=right){
+		skinRuns(scratch, inputImage, left, a, right+1, b, scale, false, longest);
+		for(k=b-a-1; k>=0 && longest[k]<strucWidth; k--);
+		if(k>=0) bottom = std::min(y1-1, a+k+grow);
+	}
+	
+	startX = left;
+	startY = top;
+	w = right-left+1;
+	h = bottom-top+1;
+}
+
+/*
+    Segment skin inside the window [x0,x1)x[y0,y1) and return the bounding box of the largest component.
+    The search runs on the window reduced faceScale times (blocks averaged), with the structuring
+    element reduced alike; only the edges of the box found are then refined at full resolution.
+    With coarse, the reduced window is read from the coarse image of a frame read compressed,
+    reduced by the JPEG decoder instead, and only the box found is decoded at full resolution.
+    Y, Cr and Cb are normalised by their largest values in the window. Around a tracked face those
+    are the values of the whole frame as long as its brightest pixels are in the window, which they
+    usually are on the face; otherwise the skin threshold, and the box, can differ by a pixel or so
+    from a search of the whole frame.
+*/
+int findFaceBox(TilePool * tilePool, FrameScratch & scratch, FrameResult & result, int x0, int y0, int x1, int y1, int coarse, int & startX, int & startY, int & w, int & h){
+	RGBImage & inputImage = result.inputImage, & face = result.face;
+	int x, y;
+	float max[3] = {0, 0, 0}, scale[3];   // largest Y, Cr and Cb in the window
+	int step = faceScale;
+	int strucWidth = step==1 ? 11 : ((11/step) | 1);
+	int winWidth = (x1-x0)/step, winHeight = (y1-y0)/step;   // size of the reduced window
+	
+	BitMask & binary = scratch.skin;
+	Plane<float> & Y = scratch.Y, & Cr = scratch.Cr, & Cb = scratch.Cb;
+	const ColorKernels & kernels = colorKernels();
+	
+	if(winWidth<=0 || winHeight<=0)
+		return 0;
+	coarse = coarse && step>1;
+	if(coarse){
+		// the reduced pixels are step x step blocks of the full image
+		x0 -= x0%step;
+		y0 -= y0%step;
+	}
+	binary.resize( winWidth, winHeight );
+	binary.setAll( 0 );
+	Y.resize( winWidth, winHeight );
+	Cr.resize( winWidth, winHeight );
+	Cb.resize( winWidth, winHeight );
+	
+	// luma and chroma planes of the window, and their maxima, in row bands
+	StageTimer skinTimer(STAGE_SKIN);
+	int bands = forBands(tilePool, scratch.bands, winHeight, MIN_BAND_ROWS, [&](BandScratch & band, int ya, int yb){
+		band.max[0] = band.max[1] = band.max[2] = 0;
+		if(step>1)
+			band.level.resize( winWidth );
+		for(int y=ya; y<yb; y++){
+			const unsigned int * row = rowOf(inputImage, x0, y0+y);
+			if(coarse)
+				row = rowOf(result.coarse, x0/step, y0/step+y);
+			else if(step>1){
+				downsampleRow(inputImage, x0, y0+y*step, step, winWidth, &band.level[0]);
+				row = &band.level[0];
+			}
+			kernels.ycrcbRow(row, winWidth, &Y(0,y), &Cr(0,y), &Cb(0,y), band.max);
+		}
+	});
+	for(int b=0; b<bands; b++){
+		for(int k=0; k<3; k++)
+			max[k] = std::max(max[k], scratch.bands[b].max[k]);
+	}
+	
+	// skin pixels, with each plane normalised to 0..255
+	for(int k=0; k<3; k++)
+		scale[k] = 255/max[k];
+	forBands(tilePool, scratch.bands, winHeight, MIN_BAND_ROWS, [&](BandScratch & band, int ya, int yb){
+		band.lineMask.resize( winWidth );
+		for(int y=ya; y<yb; y++){
+			kernels.skinMaskRow(&Y(0,y), &Cr(0,y), &Cb(0,y), winWidth, scale, &band.lineMask[0]);
+			binary.setRow(y, 0, &band.lineMask[0], winWidth);
+		}
+	});
+	
+	// erosion and two dilations with a square structuring element; two dilations are one with a square twice as large
+	skinTimer.stop();
+	StageTimer morphTimer(STAGE_MORPHOLOGY);
+	bandMorphology(tilePool, scratch.bands, binary, strucWidth/2 + strucWidth-1, [&](RectMorphology & morph, BitMask & mask){
+		morph.erode( mask, mask, strucWidth, strucWidth, strucWidth/2, strucWidth/2 );
+		morph.dilate( mask, mask, 2*strucWidth-1, 2*strucWidth-1, strucWidth-1, strucWidth-1 );
+	});
+	morphTimer.stop();
+	
+	for (x = 0; result.level==OUTPUT_DEBUG && x < winWidth*step;  x++) {
+		for (y = 0; y < winHeight*step; y++) {
+			if (binary(x/step,y/step)) {
+				face(x+x0,y+y0) = COLOR_RGB(255,255,255);
+			}
+		}
+	}
+
+	StageTimer ccTimer(STAGE_COMPONENTS);
+	ComponentLabeller & cc = scratch.cc;
+	cc.analyzeBinary( binary, EIGHT_CONNECTED );
+	int area = 0;
+	
+	for(int c = 0; c < cc.getNumComponents(); c++){
+		int ch = cc.getStats(c).height();  // height of bounding box
+		int cw = cc.getStats(c).width();   // width of bounding box
+
+		if(area < cw*ch){  //get the biggest component image
+			area = cw*ch;
+			cc.getBoundary(c,startX,startY,w,h);
+		}
+	}
+	ccTimer.stop();
+	if(area==0)
+		return 0;
+	
+	startX = x0 + startX*step;
+	startY = y0 + startY*step;
+	w *= step;
+	h *= step;
+	if(coarse){
+		// as far out as the refinement looks, and moves an edge by less than its structuring element
+		int margin = step + 11;
+		decodeRegion(result, startX-margin, startY-margin, startX+w+margin, startY+h+margin);
+	}
+	if(step>1){
+		StageTimer refineTimer(STAGE_SKIN);
+		refineFaceBox(scratch, inputImage, x0, y0, x1, y1, step, 11, scale, startX, startY, w, h);
+	}
+	return 1;
+}
+
+/* Function to find the face box of a frame, only around the face of the previous frame while it is tracked */
+int locateFace(Session & s, FrameScratch & scratch, FrameResult & result, FaceTrack & track, int width, int height, int & startX, int & startY, int & w, int & h){
+	int found=0;
+	RGBImage & face = result.face;
+	
+	if(result.level==OUTPUT_DEBUG){
+		face.resize(width, height);
+		face.setAll(0);
+	}
+	
+	/* search only around the face of the previous frame */
+	if(s.trackFace && track.found && result.index%redetectInterval!=0){
+		int x0, y0, x1, y1;
+		faceWindow(track, width, height, x0, y0, x1, y1);
+		decodeRegion(result, x0, y0, x1, y1);
+		found = findFaceBox(s.tilePool, scratch, result, x0, y0, x1, y1, 0, startX, startY, w, h);
+		
+		// lost or drifted: the box touches an inner edge of the window or its size jumped
+		if(found && ((x0>0 && startX<=x0) || (y0>0 && startY<=y0) || (x1<width && startX+w>=x1) || (y1<height && startY+h>=y1)
+		   || 2*w*h < track.w*track.h || w*h > 2*track.w*track.h)){
+			found = 0;
+			if(result.level==OUTPUT_DEBUG)
+				face.setAll(0);
+		}
+	}
+	if(!found){
+		int coarse = !result.jpeg.empty() && faceScale>1 && decodeCoarse(result);
+		if(!coarse)
+			decodeRegion(result, 0, 0, width, height);
+		found = findFaceBox(s.tilePool, scratch, result, 0, 0, width, height, coarse, startX, startY, w, h);
+	}
+	
+	if(found){
+		track.x = startX;
+		track.y = startY;
+		track.w = w;
+		track.h = h;
+	}
+	track.found = found;
+	return found;
+}
+
+/* Function to box the face and its eye band in the output image */
+void drawFace(RGBImage & outputImage, int startX, int startY, int w, int h){
+	int x, y;
+	
+	/* Box the face */
+	for (x = startX; x < startX+w;  x++) {
+		outputImage(x,startY) = COLOR_RGB(255,0,0);     // top
+		outputImage(x,startY+h-1) = COLOR_RGB(255,0,0); // bottom
+	}
+	for (y = startY; y < startY+h;  y++) {
+		outputImage(startX,y) = COLOR_RGB(255,0,0);     // left
+		outputImage(startX+w-1,y) = COLOR_RGB(255,0,0); // right
+	}
+
+	int eyeHeight = h/6;
+	for (x = startX; x < startX+w;  x++) {
+		outputImage(x,startY+eyeHeight) = COLOR_RGB(255,0,0);                // upper bound
+		outputImage(x,startY+2*eyeHeight+eyeHeight/2) = COLOR_RGB(255,0,0);  // lower bound
+	}
+	for(y=startY+eyeHeight; y<startY+2*eyeHeight+eyeHeight/2; y++){
+		outputImage(startX+w/2,y) = COLOR_RGB(255,0,0);  // middle line
+	}
+}
+
+/* Function to detect face */
+void detectFace(Session & s, FrameScratch & scratch, FrameResult & result, FaceTrack & track, int width, int height){
+	int startX=0, startY=0, w=0, h=0;
+	RGBImage & inputImage = result.inputImage;
+	RGBImage & outputImage = result.outputImage;
+	
+	locateFace(s, scratch, result, track, width, height, startX, startY, w, h);
+	if(result.level>=OUTPUT_FINAL)
+		drawFace(outputImage, startX, startY, w, h);
+	
+	int eyeHeight = h/6;
+	decodeRegion(result, startX, startY+eyeHeight, startX+w, startY+2*eyeHeight+eyeHeight/2);
+	detectEye(s, scratch, inputImage, outputImage, result, startX, startY, w, eyeHeight); 
+}
+
+/* Function to sum the gray values of the 8x8 blocks of a box */
+void blockSums(FrameScratch & scratch, RGBImage & inputImage, int x0, int y0, int w, int h, std::vector<int> & sums){
+	const ColorKernels & kernels = colorKernels();
+	int blocksX = w/8, blocksY = h/8;
+	
+	sums.assign(blocksX*blocksY, 0);
+	scratch.lineGray.resize(blocksX*8);
+	for(int y=0; y<blocksY*8; y++){
+		kernels.grayRow(rowOf(inputImage, x0, y0+y), blocksX*8, &scratch.lineGray[0]);
+		int * row = &sums[(y/8)*blocksX];
+		for(int x=0; x<blocksX*8; x++)
+			row[x/8] += scratch.lineGray[x];
+	}
+}
+
+/*
+    Function to copy the analysis of a frame: what commitFrame and the compositor read but the pixels of
+    the frame. The eye images are drawn from the analysis alone, the pupil painted on white, so they are
+    copied too.
+*/
+void copyAnalysis(FrameResult & to, const FrameResult & from){
+	if(to.level>=OUTPUT_FINAL && from.level>=OUTPUT_FINAL){
+		to.eye[0] = from.eye[0];
+		to.eye[1] = from.eye[1];
+	}
+	for(int k=0; k<2; k++){
+		to.eyeCols[k] = from.eyeCols[k];
+		to.eyeRows[k] = from.eyeRows[k];
+		to.area[k] = from.area[k];
+		to.notBlink[k] = from.notBlink[k];
+		to.eyeFound[k] = from.eyeFound[k];
+		to.pupilHeight[k] = from.pupilHeight[k];
+		to.eyeHeight[k] = from.eyeHeight[k];
+		to.pupilBlack[k] = from.pupilBlack[k];
+		to.eyeBlack[k] = from.eyeBlack[k];
+		to.momentX[k] = from.momentX[k];
+		to.momentY[k] = from.momentY[k];
+		for(int j=0; j<4; j++){
+			to.pupilBox[k][j] = from.pupilBox[k][j];
+			to.eyeBox[k][j] = from.eyeBox[k][j];
+		}
+	}
+}
+
+/* Function to clear the analysis of a frame, as of a frame where nothing was found */
+void clearAnalysis(FrameResult & result){
+	for(int k=0; k<2; k++){
+		result.eyeCols[k] = result.eyeRows[k] = 0;
+		result.area[k] = result.notBlink[k] = result.eyeFound[k] = 0;
+		result.pupilHeight[k] = result.eyeHeight[k] = 0;
+		result.pupilBlack[k] = result.eyeBlack[k] = 0;
+		result.momentX[k] = result.momentY[k] = 0;
+		for(int j=0; j<4; j++)
+			result.pupilBox[k][j] = result.eyeBox[k][j] = 0;
+	}
+}
+
+/*
+    Function to tell whether the face box of a frame still matches the last analyzed frame:
+    no 8x8 block of it changed by more than the staticThreshold of the session gray levels on average.
+    Frames are compared with the last analyzed one, not the previous one, so a slow drift
+    is analyzed again once it adds up.
+*/
+int isStaticFrame(Session & s, FrameScratch & scratch, FrameResult & result, FaceTrack & track){
+	if(s.staticThreshold<=0 || result.level==OUTPUT_DEBUG || !track.found || track.blocks.empty()
+	   || result.index%redetectInterval==0)
+		return 0;
+	if(track.x+track.w>result.inputImage.width() || track.y+track.h>result.inputImage.height())
+		return 0;
+	
+	// with the rest of the window that the face search of the frame reads if it is not static
+	int x0, y0, x1, y1;
+	faceWindow(track, result.inputImage.width(), result.inputImage.height(), x0, y0, x1, y1);
+	decodeRegion(result, x0, y0, x1, y1);
+	
+	std::vector<int> & sums = scratch.blockSums;
+	blockSums(scratch, result.inputImage, track.x, track.y, track.w, track.h, sums);
+	for(size_t k=0; k<sums.size(); k++){
+		if(abs(sums[k]-track.blocks[k]) > s.staticThreshold*64)
+			return 0;
+	}
+	return 1;
+}
+
+/* Function to analyze one frame; depends only on the frame and the face track of its chunk */
+void analyzeFrame(Session & s, FrameScratch & scratch, FrameResult & result, FaceTrack & track){
+	int width = result.inputImage.width();
+	int height = result.inputImage.height();
+	
+	TraceFrame context(s.tracer, result.index);
+	
+	result.isStatic = isStaticFrame(s, scratch, result, track);
+	if(result.isStatic){
+		// the boxes of the last analysis, on this frame
+		copyAnalysis(result, track.last);
+		if(result.level>=OUTPUT_FINAL){
+			result.outputImage = result.inputImage;
+			drawFace(result.outputImage, track.x, track.y, track.w, track.h);
+			for(int eyeNum=0; eyeNum<2; eyeNum++){
+				drawBox(result.outputImage, result.pupilBox[eyeNum], COLOR_RGB(0,255,0));
+				drawBox(result.outputImage, result.eyeBox[eyeNum], COLOR_RGB(0,0,255));
+			}
+		}
+		return;
+	}
+	if(result.level>=OUTPUT_FINAL)
+		result.outputImage = result.inputImage;
+	detectFace(s, scratch, result, track, width, height);
+	
+	/* keep this analysis for the frames that do not change */
+	track.blocks.clear();
+	if(s.staticThreshold>0 && result.level!=OUTPUT_DEBUG && track.found){
+		decodeRegion(result, track.x, track.y, track.x+track.w, track.y+track.h);
+		blockSums(scratch, result.inputImage, track.x, track.y, track.w, track.h, track.blocks);
+		track.last.level = result.level;
+		copyAnalysis(track.last, result);
+	}
+}
+
+/* Function to copy the w x h block at (sx,sy) of src to (dx,dy) of dst a row at a time, clipped to both images */
+void blit(RGBImage & dst, int dx, int dy, const RGBImage & src, int sx, int sy, int w, int h){
+	if(dx<0){ sx -= dx; w += dx; dx = 0; }
+	if(dy<0){ sy -= dy; h += dy; dy = 0; }
+	w = std::min(w, std::min(dst.width()-dx, src.width()-sx));
+	h = std::min(h, std::min(dst.height()-dy, src.height()-sy));
+	for(int y=0; y<h; y++)
+		memcpy(&dst(dx,dy+y), rowOf(src, sx, sy+y), w*sizeof(unsigned int));
+}
+
+/* Function to render the parts of the final output that do not change, for frames of width x height */
+void buildLayout(Session & s, int width, int height){
+	RGBImage & layout = s.layout;
+	
+	layout.resize(width+2*boxWidth+100, height+200);
+	layout.setAll(0);
+	blit(layout, 250, 0, title, 0, 0, 690, 100);                        // titles
+	blit(layout, 0, 100, leftTitle, 0, 0, 275, 100);
+	blit(layout, boxWidth+50+width, 100, rightTitle, 0, 0, 275, 100);
+	blit(layout, 0, height+100, label, 0, 0, 65, 100);                  // graph label
+}
+
+/* Function to tell whether two rectangles (x, y, width, height) overlap */
+int overlaps(const int a[4], const int b[4]){
+	return a[0]<b[0]+b[2] && b[0]<a[0]+a[2] && a[1]<b[1]+b[3] && b[1]<a[1]+a[3];
+}
+
+/*
+    Function to build the final output frame.
+    The frame buffers are reused, so a buffer already holds the layout and the
+    parts of an earlier frame: only the regions that change are copied, the
+    output image, the direction panels, the eyes and the graph columns added
+    since the buffer was last composed. An eye smaller than the one before it
+    first gets the layout back under the old one.
+*/
+void composeFrame(Session & s, FrameResult & result){
+	RGBImage & graph = s.graph;
+	int width = result.outputImage.width();
+	int height = result.outputImage.height();
+	RGBImage & outputImage = result.outputImage;
+	RGBImage & finalOutputImage = result.finalOutputImage;
+	StageTimer timer(STAGE_COMPOSE);
+	int k;
+	
+	if(s.layout.width()!=width+2*boxWidth+100 || s.layout.height()!=height+200)
+		buildLayout(s, width, height);
+	int graphRect[4] = { 65, height+100, graph.width(), 100 };
+	int eyeRect[2][4] = {
+		{ 65, boxHeight+230, result.eyeResized[0].width(), result.eyeResized[0].height() },
+		{ boxWidth+width+115, boxHeight+230, result.eyeResized[1].width(), result.eyeResized[1].height() } };
+	
+	if(finalOutputImage.width()!=s.layout.width() || finalOutputImage.height()!=s.layout.height()){
+		finalOutputImage.resize(s.layout.width(), s.layout.height());
+		result.composed = 0;
+	}
+	if(!result.composed){
+		blit(finalOutputImage, 0, 0, s.layout, 0, 0, s.layout.width(), s.layout.height());
+		result.graphColumns = 0;
+		for(k=0; k<2; k++)
+			result.composedEye[k][2] = result.composedEye[k][3] = 0;
+		result.composed = 1;
+	}
+	
+	/* the layout back under the eyes of the frame this buffer held */
+	for(k=0; k<2; k++){
+		int * old = result.composedEye[k];
+		blit(finalOutputImage, old[0], old[1], s.layout, old[0], old[1], old[2], old[3]);
+		if(overlaps(old, graphRect) || overlaps(eyeRect[k], graphRect))
+			result.graphColumns = 0;      // the graph is drawn over the eyes
+		for(int j=0; j<4; j++)
+			old[j] = eyeRect[k][j];
+	}
+	
+	blit(finalOutputImage, boxWidth+50, 100, outputImage, 0, 0, width, height);                  // output image
+	blit(finalOutputImage, 25, 200, result.eyeDirection[0], 0, 0, boxWidth, boxHeight);         // eye direction
+	blit(finalOutputImage, eyeRect[0][0], eyeRect[0][1], result.eyeResized[0], 0, 0, eyeRect[0][2], eyeRect[0][3]);   // eye
+	blit(finalOutputImage, boxWidth+width+75, 200, result.eyeDirection[1], 0, 0, boxWidth, boxHeight);
+	blit(finalOutputImage, eyeRect[1][0], eyeRect[1][1], result.eyeResized[1], 0, 0, eyeRect[1][2], eyeRect[1][3]);
+	
+	/* graph, oldest frame first: once the ring is full every column moves, before that only new ones are added */
+	if(s.graphFull){
+		int oldest = s.graphX;
+		blit(finalOutputImage, graphRect[0], graphRect[1], graph, oldest, 0, graph.width()-oldest, 100);
+		blit(finalOutputImage, graphRect[0]+graph.width()-oldest, graphRect[1], graph, 0, 0, oldest, 100);
+		result.graphColumns = -1;
+	}
+	else{
+		int from = std::max(result.graphColumns, 0);
+		blit(finalOutputImage, graphRect[0]+from, graphRect[1], graph, from, 0, s.graphX-from, 100);
+		result.graphColumns = s.graphX;
+	}
+}
+
+/* Function to render the output images of a committed frame, as far as the output level asks for them */
+void renderFrame(Session & s, FrameResult & result){
+	TraceFrame context(s.tracer, result.index);
+	if(result.level>=OUTPUT_FINAL)
+		composeFrame(s, result);
+}
+
+/* Function to write the images of a frame */
+void writeFrame(Session & s, FrameResult & result){
+	char filename[300];
+	int i = result.index;
+	
+	if(result.level==OUTPUT_RESULTS)
+		return;
+	TraceFrame context(s.tracer, i);
+	StageTimer timer(STAGE_ENCODE);
+	if(result.level==OUTPUT_DEBUG){
+		for(int eyeNum=0; eyeNum<2; eyeNum++){
+			sprintf(filename, "%s/eye/%d/%d.jpg", s.outputPath, eyeNum, i);
+			writeJpeg( result.eye[eyeNum], filename, 100 );
+			sprintf(filename, "%s/eyeDirection/%d/%d.jpg", s.outputPath, eyeNum, i);
+			writeJpeg( result.eyeDirection[eyeNum], filename, 100 );
+			sprintf(filename, "%s/eyeResized/%d/%d.jpg", s.outputPath, eyeNum, i);
+			writeJpeg( result.eyeResized[eyeNum], filename, 100 );
+		}
+		sprintf(filename, "%s/face/%d.jpg", s.outputPath, i);
+		writeJpeg( result.face, filename, 100 ); 
+		
+		sprintf(filename, "%s/output/%d.jpg", s.outputPath, i);
+		writeJpeg( result.outputImage, filename, 100 );
+	}
+	
+	// write the output to the video or to a JPEG file
+	if(s.video){
+		std::vector<unsigned char> jpeg;
+		encodeJpeg(result.finalOutputImage, 100, jpeg);
+		s.video->addFrame(i, result.finalOutputImage.width(), result.finalOutputImage.height(), jpeg);
+	}
+	else{
+		sprintf(filename, "%s/finalOutput/%d.jpg", s.outputPath, i);
+		writeJpeg( result.finalOutputImage, filename, 100 ); 
+	}
+}
+
+/* Function to open the output video of a session */
+void openVideo(Session & s){
+	char filename[300];
+	
+	if(!videoOutput || s.outputLevel==OUTPUT_RESULTS)
+		return;
+	sprintf(filename, "%s/finalOutput.avi", s.outputPath);
+	s.video = new AviWriter;
+	if(!s.video->open(filename, videoRate)){
+		fprintf(stderr, "\nCannot write %s", filename);
+		delete s.video;
+		s.video = NULL;
+	}
+}
+
+/* Function to start the stage trace of a session and its per-frame table */
+void startTrace(Session & s){
+	char filename[300], table[300];
+	
+	if(!tracing)
+		return;
+	sprintf(filename, "%s/trace.json", s.outputPath);
+	sprintf(table, "%s/frames.csv", s.outputPath);
+	s.tracer = new Tracer;
+	if(!s.tracer->open(filename, table))
+		fprintf(stderr, "\nCannot write %s or %s", filename, table);
+}
+
+/* Function to finish the stage trace of a session */
+void finishTrace(Session & s){
+	if(!s.tracer)
+		return;
+	s.tracer->close();
+}
+
+/* Function to open the gaze log of a session */
+void openLog(Session & s){
+	char filename[300];
+	
+	sprintf(filename, "%s/gaze.log", s.outputPath);
+	s.log = new GazeLog;
+	if(!s.log->open(filename)){
+		fprintf(stderr, "\nCannot write %s", filename);
+		delete s.log;
+		s.log = NULL;
+	}
+}
+
+/*
+    Function to render the graph of a whole gaze log into a JPEG, two columns per frame.
+    A JPEG is at most 65535 pixels wide, so a longer log is rendered from its last frames.
+*/
+int renderTimeline(const char * logFile, const char * jpegFile){
+	GazeLogView log;
+	RGBImage graph;
+	int previousY = 60, first = 0, frames = 0, k;
+	
+	if(!log.open(logFile)){
+		fprintf(stderr, "\nCannot read %s", logFile);
+		return 0;
+	}
+	for(k=0; k<log.size(); k++)
+		if(log[k].flags & GAZE_SELECTED)
+			frames++;
+	if(frames>32000)
+		first = frames-32000;
+	graph.resize(2*(frames-first) > 0 ? 2*(frames-first) : 2, 100);
+	graph.setAll(COLOR_RGB(0,0,0));
+	for(k=0, frames=0; k<log.size(); k++){
+		if(!(log[k].flags & GAZE_SELECTED))
+			continue;
+		if(frames>=first)
+			drawGraph(graph, 2*(frames-first), previousY, log[k]);
+		previousY = graphLevel(log[k]);
+		frames++;
+	}
+	writeJpeg(graph, jpegFile, 100);
+	return 1;
+}
+
+/* Function to close the gaze log of a session; at OUTPUT_DEBUG its whole graph is rendered into graph/timeline.jpg */
+void closeLog(Session & s){
+	char filename[300], timeline[300];
+	
+	if(!s.log)
+		return;
+	s.log->close();
+	delete s.log;
+	s.log = NULL;
+	if(s.outputLevel==OUTPUT_DEBUG){
+		sprintf(filename, "%s/gaze.log", s.outputPath);
+		sprintf(timeline, "%s/graph/timeline.jpg", s.outputPath);
+		renderTimeline(filename, timeline);
+	}
+}
+
+/* Function to finish the output video of a session, after its last frame was written */
+void closeVideo(Session & s){
+	if(s.video){
+		s.video->close();
+		delete s.video;
+		s.video = NULL;
+	}
+}
+
+/*
+    Frame pipeline: a decode thread reads the frames in chunks of redetectInterval,
+    the analysis workers each take a chunk and run detectFace/detectEye on it,
+    and main commits the results in frame order before handing them to the encoder pool.
+*/
+typedef std::vector<FrameResult*> FrameChunk;
+
+/* Analyzed frames waiting for their turn to be committed */
+struct ReorderBuffer {
+	std::map<int, FrameResult*> ready;
+	int next;      // next frame to commit
+	int window;    // how far the analysis may run ahead of the commit
+	int frames;    // number of frames in the clip, -1 until the decoder reaches its end
+	std::mutex mutex;
+	std::condition_variable changed;
+};
+
+/*
+    Function to read the next frame of a source into result. With roiDecode the frames of a JPEG
+    source are read still compressed, and the analysis decodes only what it reads of them.
+*/
+int readFrame(FrameSource * source, FrameResult & result){
+	int width=0, height=0;
+	
+	result.jpeg.clear();
+	if(!roiDecode || !source->encoded())
+		return source->read(result.inputImage);
+	if(!source->readEncoded(result.jpeg))
+		return 0;
+	jpegSize(result.jpeg, width, height);   // a corrupt file of a folder is an empty frame
+	result.inputImage.resize(width, height);
+	result.decoded[0] = result.decoded[1] = result.decoded[2] = result.decoded[3] = 0;
+	return 1;
+}
+
+void decodeFrames(Session * s, BoundedQueue<FrameChunk> * chunks, ReorderBuffer * reorder){
+	FrameChunk chunk;
+	int i = 0;
+	
+	FrameSource * source = openFrameSource(s->input, prefetchFrames, s->tracer, roiDecode);
+	if(source){
+		FrameResult * result = takeFrame(*s);
+		while(readFrame(source, *result)){
+			result->index = i++;
+			chunk.push_back(result);
+			if((int)chunk.size()==redetectInterval){
+				chunks->push(chunk);
+				chunk.clear();
+			}
+			result = takeFrame(*s);
+		}
+		recycleFrame(*s, result);
+		delete source;
+	}
+	else
+		fprintf(stderr, "\nCannot open %s", s->input);
+	if(!chunk.empty())
+		chunks->push(chunk);
+	chunks->close();
+	
+	std::lock_guard<std::mutex> lock(reorder->mutex);
+	reorder->frames = i;
+	reorder->changed.notify_all();
+}
+
+void analyzeFrames(Session * s, BoundedQueue<FrameChunk> * chunks, ReorderBuffer * reorder){
+	FrameChunk chunk;
+	FrameScratch scratch;
+	
+	while(chunks->pop(chunk)){
+		FaceTrack track;
+		for(size_t k=0; k<chunk.size(); k++){
+			FrameResult * result = chunk[k];
+			{
+				std::unique_lock<std::mutex> lock(reorder->mutex);
+				reorder->changed.wait(lock, [&]{ return result->index < reorder->next + reorder->window; });
+			}
+			analyzeFrame(*s, scratch, *result, track);
+			
+			std::lock_guard<std::mutex> lock(reorder->mutex);
+			reorder->ready[result->index] = result;
+			reorder->changed.notify_all();
+		}
+	}
+}
+
+/* Function to process a session on the frame pipeline */
+void runPipeline(Session & s){
+	int i;
+	
+	BoundedQueue<FrameChunk> chunks(queueSize);
+	EncoderPool<FrameResult> encoders(numEncoders, queueSize, [&s](FrameResult & result){ writeFrame(s, result); },
+		[&s](FrameResult * result){ recycleFrame(s, result); });
+	ReorderBuffer reorder;
+	reorder.next = 0;
+	reorder.frames = -1;
+	reorder.window = 2*numWorkers*redetectInterval;
+	
+	startTrace(s);
+	openVideo(s);
+	openLog(s);
+	std::thread decoder(decodeFrames, &s, &chunks, &reorder);
+	std::vector<std::thread> workers;
+	for(i=0; i<numWorkers; i++)
+		workers.push_back(std::thread(analyzeFrames, &s, &chunks, &reorder));
+	
+	/* commit in frame order */
+	for(i=0; ; i++){
+		FrameResult * result;
+		{
+			std::unique_lock<std::mutex> lock(reorder.mutex);
+			reorder.changed.wait(lock, [&]{ return reorder.ready.count(i)>0 || (reorder.frames>=0 && i>=reorder.frames); });
+			if(!reorder.ready.count(i))
+				break;
+			result = reorder.ready[i];
+			reorder.ready.erase(i);
+		}
+		
+		commitFrame(s, *result);
+		renderFrame(s, *result);
+		encoders.submit(result);
+		
+		std::lock_guard<std::mutex> lock(reorder.mutex);
+		reorder.next = i+1;
+		reorder.changed.notify_all();
+	}
+	
+	decoder.join();
+	for(i=0; i<numWorkers; i++)
+		workers[i].join();
+	encoders.flush();
+	closeVideo(s);
+	closeLog(s);
+	finishTrace(s);
+}
+
+/* Function to process a session on the calling thread */
+void runSession(Session & s){
+	FaceTrack track;
+	FrameScratch scratch;
+	EncoderPool<FrameResult> encoders(numEncoders, queueSize, [&s](FrameResult & result){ writeFrame(s, result); },
+		[&s](FrameResult * result){ recycleFrame(s, result); });
+	
+	startTrace(s);
+	FrameSource * source = openFrameSource(s.input, prefetchFrames, s.tracer, roiDecode);
+	if(!source){
+		fprintf(stderr, "\nCannot open %s", s.input);
+		closeVideo(s);
+		closeLog(s);
+		finishTrace(s);
+		return;
+	}
+	openVideo(s);
+	openLog(s);
+	for(int i=0; ; i++){
+		FrameResult * result = takeFrame(s);
+		if(!readFrame(source, *result)){
+			recycleFrame(s, result);
+			break;
+		}
+		result->index = i;
+		
+		analyzeFrame(s, scratch, *result, track);
+		commitFrame(s, *result);
+		renderFrame(s, *result);
+		encoders.submit(result);
+	}
+	encoders.flush();
+	closeVideo(s);
+	closeLog(s);
+	finishTrace(s);
+	delete source;
+}
+
+/*
+    Function to commit frame i of the capture, which was not analyzed, with the analysis of the last
+    analyzed frame carried forward as for a static frame; the output video gets an empty frame for it
+*/
+void dropFrame(Session & s, const FrameResult & last, int i){
+	FrameResult * result = takeFrame(s);
+	result->index = i;
+	result->level = OUTPUT_RESULTS;
+	result->isStatic = 1;
+	copyAnalysis(*result, last);
+	commitFrame(s, *result);
+	recycleFrame(s, result);
+	s.dropped++;
+	if(s.video)
+		s.video->skipFrame(i);
+}
+
+#define RECOVER_FRAMES 30   // frames well within the budget before the real-time driver restores a step of the output
+
+/*
+    Function to process a session in real time, with a budget of realtimeBudget ms from the capture
+    of a frame to its commit.
+    Frames are taken from a live capture as they arrive, newest first: those that arrived while the
+    last one was analyzed are passed over, and a frame already older than the budget when it is taken
+    is stale and dropped too. A dropped frame is committed with the analysis of the last analyzed
+    frame, so the counters, the gaze log and the graph still cover every frame of the capture.
+    When a frame misses its budget the output of the next frames is reduced a level, the debug images
+    first, then the composite and its encoding; a level comes back after RECOVER_FRAMES frames within
+    half the budget. The level is that of each frame, so the other sessions of a batch are not affected.
+*/
+void runRealtime(Session & s){
+	typedef std::chrono::steady_clock Clock;
+	FaceTrack track;
+	FrameScratch scratch;
+	FrameResult last;   // the analysis of the last analyzed frame, without its images
+	EncoderPool<FrameResult> encoders(numEncoders, queueSize, [&s](FrameResult & result){ writeFrame(s, result); },
+		[&s](FrameResult * result){ recycleFrame(s, result); });
+	int configured = s.outputLevel;   // also the levels the output can be reduced by, down to OUTPUT_RESULTS
+	int degrade = 0, calm = 0, next = 0, index, level = configured;
+	Clock::time_point captured, start = Clock::now();
+	
+	startTrace(s);
+	FrameSource * source = openFrameSource(s.input, 0, s.tracer);
+	if(!source){
+		fprintf(stderr, "\nCannot open %s", s.input);
+		closeVideo(s);
+		closeLog(s);
+		finishTrace(s);
+		return;
+	}
+	LiveSource live(source, isLiveInput(s.input) ? 0 : videoRate);
+	openVideo(s);
+	openLog(s);
+	last.level = OUTPUT_RESULTS;
+	clearAnalysis(last);
+	while(true){
+		FrameResult * result = takeFrame(s);
+		if(!live.take(result->inputImage, index, captured)){
+			recycleFrame(s, result);
+			break;
+		}
+		for(; next<index; next++)
+			dropFrame(s, last, next);
+		next = index+1;
+		if(std::chrono::duration<double, std::milli>(Clock::now()-captured).count() > realtimeBudget){
+			s.stale++;
+			dropFrame(s, last, index);
+			recycleFrame(s, result);
+			continue;
+		}
+		
+		result->index = index;
+		result->level = level;
+		analyzeFrame(s, scratch, *result, track);
+		commitFrame(s, *result);
+		copyAnalysis(last, *result);
+		if(result->level>=OUTPUT_FINAL){
+			renderFrame(s, *result);
+			encoders.submit(result);
+		}
+		else{
+			if(s.video)
+				s.video->skipFrame(index);
+			recycleFrame(s, result);
+		}
+		if(degrade)
+			s.degraded++;
+		double latency = std::chrono::duration<double, std::milli>(Clock::now()-captured).count();
+		s.latency.add(latency);
+		
+		if(latency>realtimeBudget){
+			if(degrade<configured)
+				degrade++;
+			calm = 0;
+		}
+		else if(latency<realtimeBudget/2.0 && degrade>0 && ++calm>=RECOVER_FRAMES){
+			degrade--;
+			calm = 0;
+		}
+		if(configured-degrade!=level){
+			level = configured-degrade;
+			track.blocks.clear();   // the last analysis was rendered for the other level
+		}
+	}
+	s.captured = live.frames();
+	encoders.flush();
+	s.seconds = std::chrono::duration<double>(Clock::now()-start).count();
+	closeVideo(s);
+	closeLog(s);
+	finishTrace(s);
+}
+
+/*
+    Function to run every lighting preset on one clip, one session per preset.
+    Each frame is decoded and its face found once, and so are the gray image and median
+    of its eye bands; only the thresholds and what follows them run once per preset.
+*/
+void runSweep(Session ** presets){
+	FrameScratch scratch;
+	FaceTrack track;
+	FrameResult frame, results[NUM_PRESETS];
+	int k;
+	
+	FrameSource * source = openFrameSource(presets[0]->input, prefetchFrames, NULL, roiDecode);
+	if(!source){
+		fprintf(stderr, "\nCannot open %s", presets[0]->input);
+		return;
+	}
+	frame.level = presets[0]->outputLevel;
+	for(k=0; k<NUM_PRESETS; k++){
+		results[k].level = presets[k]->outputLevel;
+		openLog(*presets[k]);
+	}
+	scratch.sharedBands = 1;
+	for(int i=0; readFrame(source, frame); i++){
+		int startX=0, startY=0, w=0, h=0;
+		
+		frame.index = i;
+		locateFace(*presets[0], scratch, frame, track, frame.inputImage.width(), frame.inputImage.height(), startX, startY, w, h);
+		decodeRegion(frame, startX, startY+h/6, startX+w, startY+2*(h/6)+(h/6)/2);
+		prepareEyeBands(scratch, frame.inputImage, startX, startY, w, h/6);
+		for(k=0; k<NUM_PRESETS; k++){
+			results[k].index = i;
+			results[k].isStatic = 0;
+			detectEye(*presets[k], scratch, frame.inputImage, frame.outputImage, results[k], startX, startY, w, h/6);
+			commitFrame(*presets[k], results[k]);
+		}
+	}
+	for(k=0; k<NUM_PRESETS; k++)
+		closeLog(*presets[k]);
+	delete source;
+}
+
+/* Function to display the summaries of the presets of a sweep side by side */
+void printSweepSummary(Session ** presets){
+	const char * names[] = { "Upper Left", "Left", "Lower Left", "Upper", "Center", "Lower", "Upper Right", "Right", "LowerRight", "Blink" };
+	int Session::* counters[] = { &Session::upperLeft, &Session::left, &Session::lowerLeft, &Session::up, &Session::center,
+		&Session::low, &Session::upperRight, &Session::right, &Session::lowerRight, &Session::blink };
+	int k, row;
+	
+	printf("\n\n ---------------------------------------");
+	printf("\n Summary of Results by Lighting Condition:");
+	printf("\n ---------------------------------------\n");
+	printf("\n   %-13s |", "");
+	for(k=0; k<NUM_PRESETS; k++)
+		printf(" %11s", presetNames[k]);
+	for(row=0; row<(int)(sizeof(names)/sizeof(names[0])); row++){
+		if(row==9)
+			printf("\n");
+		printf("\n   * %-11s |", names[row]);
+		for(k=0; k<NUM_PRESETS; k++)
+			printf(" %11d", presets[k]->*counters[row]);
+	}
+	printf("\n");
+}
+
+/* Function to set the thresholds of a lighting condition */
+int setLighting(Session & s, int lighting){
+	switch(lighting){
+		case 1: s.irisThreshold = 0.15;
+				s.eyeThreshold = 0.35;
+				s.centerAdjust = 2;
+				s.MARGIN=20;
+				break;
+		case 2: s.irisThreshold = 0.16;
+				s.eyeThreshold = 0.35;
+				s.centerAdjust = 0;
+				s.MARGIN=25;
+				break;
+		case 3: s.irisThreshold = 0.12;
+				s.eyeThreshold = 0.25;
+				s.centerAdjust = 1;
+				s.MARGIN=30;
+				break;
+		case 4: s.irisThreshold = 0.06;
+				s.eyeThreshold = 0.20;
+				s.centerAdjust = 1;
+				s.MARGIN=15;
+				break;
+		case 5: s.irisThreshold = 0.05;
+				s.eyeThreshold = 0.17;
+				s.centerAdjust = 3;
+				s.MARGIN=30;
+				break;
+		default: printf("Please select from one of the following options."); 
+				return 0;
+	}
+	return 1;
+}
+
+/*
+    Function to name the input of a session and its output folder, images/SP/sessions/<input>, without
+    the path of the input, or the subfolder sub of it; false if either name does not fit
+*/
+int nameSession(Session & s, const char * input, const char * sub){
+	const char * name = strrchr(input, '/') ? strrchr(input, '/')+1 : input;
+	int n;
+	
+	if(strcmp(name, "-")==0)
+		name = "stdin";
+	if(sub)
+		n = snprintf(s.outputPath, sizeof(s.outputPath), "images/SP/sessions/%s/%s", name, sub);
+	else
+		n = snprintf(s.outputPath, sizeof(s.outputPath), "images/SP/sessions/%s", name);
+	if(n>=(int)sizeof(s.outputPath) || snprintf(s.input, sizeof(s.input), "%s", input)>=(int)sizeof(s.input)){
+		printf("The name %s is too long\n", input);
+		return 0;
+	}
+	return 1;
+}
+
+/* Function to create the output folders of a session */
+void makeOutputFolders(Session & s){
+	const char * folders[] = { "", "/finalOutput", "/output", "/face", "/graph", "/median",
+		"/eye", "/eye/0", "/eye/1", "/eyeDirection", "/eyeDirection/0", "/eyeDirection/1",
+		"/eyeResized", "/eyeResized/0", "/eyeResized/1" };
+	char path[300];
+	
+	for(size_t k=0; k<sizeof(folders)/sizeof(folders[0]); k++){
+		sprintf(path, "%s%s", s.outputPath, folders[k]);
+		mkdir(path, 0755);
+	}
+}
+
+/* Function to display the counters of a session */
+void printSummary(Session & s){
+	printf("\n\n -------------------");
+	printf("\n Summary of Results:");
+	printf("\n -------------------");
+		
+	printf("\n\n Eye Direction:\n");
+	printf("\n		   Left");
+	printf("\n   * Upper Left  |  %d  ", s.upperLeft);
+	printf("\n   * Left        |  %d  ", s.left);
+	printf("\n   * Lower Left  |  %d  ", s.lowerLeft);
+	printf("\n   * Upper       |  %d  ", s.up);
+	printf("\n   * Center      |  %d  ", s.center);
+	printf("\n   * Lower       |  %d  ", s.low);
+	printf("\n   * Upper Right |  %d  ", s.upperRight);
+	printf("\n   * Right       |  %d  ", s.right);
+	printf("\n   * LowerRight  |  %d  \n\n", s.lowerRight);
+	
+	printf("\n   * Blink       |  %d  |\n", s.blink);
+	
+	if(s.staticThreshold>0)
+		printf("\n Static frames: %d of %d reused the analysis of an earlier frame\n", s.staticFrames, s.frames);
+	
+	if(realtimeBudget>0 && s.seconds>0){
+		int analyzed = s.frames-s.dropped;
+		printf("\n Real time: %d frames analyzed of %d captured, %.1f of %.1f frames/s", analyzed, s.captured, analyzed/s.seconds, s.captured/s.seconds);
+		printf("\n            %d dropped (%d stale) and committed with the analysis before them, %d with reduced output", s.dropped, s.stale, s.degraded);
+		if(s.latency.size()>0)
+			printf("\n            latency from capture to commit p50 %.1f, p95 %.1f, p99 %.1f, max %.1f ms, budget %d ms", s.latency.percentile(50),
+				s.latency.percentile(95), s.latency.percentile(99), s.latency.max(), realtimeBudget);
+		printf("\n");
+	}
+	
+	if(s.tracer)
+		s.tracer->printLatencies();
+}
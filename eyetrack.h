@@ -0,0 +1,193 @@
+/*
+    The eye direction and blink analysis and the drivers that run it over a session:
+    everything of the program but its command line, which main.cpp parses, and the
+    benchmark, which times the kernels. They are defined in eyetrack.cpp, which both
+    programs are linked with.
+*/
+
+#ifndef EYETRACK_H
+#define EYETRACK_H
+
+#define IMAGE_RANGE_CHECK
+#include "image.h"
+#include "tilepool.h"
+#include "videoout.h"
+#include "trace.h"
+#include "scratch.h"
+#include "gazelog.h"
+#include <mutex>
+#include <vector>
+#define SIZE 450   // frames shown on the timeline graph; older frames scroll out
+
+/* what is rendered and written for each frame */
+enum OutputLevel {
+	OUTPUT_RESULTS,   // only the counters, no image is rendered
+	OUTPUT_FINAL,     // the final composite only
+	OUTPUT_DEBUG      // every intermediate image as well
+};
+
+/* Options of the run, set from the command line */
+extern int outputLevel;
+extern int trackFace;         // segment only around the previous face box
+extern int redetectInterval;  // search the full frame at least this often; frames are analyzed in chunks of this size
+extern int numWorkers;        // analysis threads, 0 = one per core
+extern int queueSize;         // capacity of the decode and write queues
+extern int prefetchFrames;    // frames decoded ahead of the analysis
+extern int numEncoders;       // JPEG encoder threads of a session
+extern int videoOutput;       // write finalOutput as one MJPEG AVI instead of a JPEG per frame
+extern int videoRate;         // frames per second of that AVI
+extern int tracing;           // time the stages of every frame
+extern int faceScale;         // the face is searched on the frame reduced 1, 2 or 4 times
+extern int staticThreshold;   // gray levels an 8x8 block of the face may change by and the frame still reuse the last analysis, 0 = analyze every frame
+extern int tileThreads;       // threads that share the masks of each frame in row bands, and its two eyes, 0 = none
+extern TilePool * tilePool;   // those threads, shared by every analysis thread
+extern int realtimeBudget;    // ms from the capture of a frame to its commit in the real-time driver, 0 = every frame is processed
+extern int roiDecode;         // with OUTPUT_RESULTS, JPEG frames are decoded by the analysis, only what it reads of them
+extern RGBImage label, title, leftTitle, rightTitle;   // static parts of the final output
+
+struct FrameResult;
+
+/* State of one analysis session (one video clip) */
+struct Session {
+	char input[100];          // folder of the input frames, or a Y4M/MJPEG file, or "-" for stdin
+	char outputPath[200];     // folder that receives the output images
+	
+	/* lighting preset */
+	float irisThreshold, eyeThreshold;
+	int centerAdjust, MARGIN;
+	
+	/* blink calibration from the first eyes found */
+	int flag, overAllBlack, firstEyeHeight[2], firstMaxPupilHeight[2];
+	
+	/* direction counters */
+	int blink, upperLeft, up, upperRight, right, center, left, lowerLeft, low, lowerRight;
+	int leftFlag, rightFlag, centerFlag, blinkFlag;
+	int centerx, centery;     // center of mass
+	int frames, staticFrames; // frames committed, and those that reused the analysis of an earlier frame
+	int outputLevel;          // what is rendered and written for the frames of the session; a frame can get less, see FrameResult::level
+	int trackFace;            // options of the run, from the globals of the same name
+	int staticThreshold;
+	TilePool * tilePool;
+	
+	/* real-time driver */
+	int captured, dropped, stale, degraded;   // frames read, not analyzed (stale among them), analyzed without their full output
+	LatencyHistogram latency;                 // ms from the capture of each analyzed frame to its commit
+	double seconds;                           // wall time of the session
+	
+	/* timeline graph, a ring buffer of columns */
+	RGBImage graph;
+	int graphX, previousY;    // column of the next frame, and the level of the last one
+	int graphFull;            // graphX has wrapped around: the oldest column is at graphX
+	
+	AviWriter * video;        // finalOutput.avi, or NULL for one JPEG per frame
+	Tracer * tracer;          // stage timings, or NULL
+	GazeLog * log;            // gaze.log, or NULL
+	
+	/* buffers reused from frame to frame */
+	std::vector<FrameResult*> spareFrames;   // written frames, see takeFrame/recycleFrame
+	std::mutex spareMutex;
+	RGBImage eyeOverlay;                     // scratch of commitFrame
+	RGBImage layout;                         // the static parts of the final output, see composeFrame
+	
+	Session(){
+		input[0] = 0;
+		strcpy(outputPath, "images/SP");
+		irisThreshold = eyeThreshold = 0;
+		centerAdjust = MARGIN = 0;
+		flag = overAllBlack = 0;
+		firstEyeHeight[0] = firstEyeHeight[1] = firstMaxPupilHeight[0] = firstMaxPupilHeight[1] = 0;
+		blink = upperLeft = up = upperRight = right = center = left = lowerLeft = low = lowerRight = 0;
+		leftFlag = rightFlag = centerFlag = blinkFlag = 0;
+		centerx = centery = 0;
+		frames = staticFrames = 0;
+		outputLevel = ::outputLevel;
+		trackFace = ::trackFace;
+		staticThreshold = ::staticThreshold;
+		tilePool = ::tilePool;
+		captured = dropped = stale = degraded = 0;
+		seconds = 0;
+		graph.resize(SIZE*2, 100);
+		graph.setAll(COLOR_RGB(0,0,0));
+		graphX = 0;
+		previousY = 60;
+		graphFull = 0;
+		video = NULL;
+		tracer = NULL;
+		log = NULL;
+	}
+	
+	~Session();
+};
+
+/* Per-frame results, filled by detectFace/detectEye and read by the compositor */
+struct FrameResult {
+	int index;                 // frame number
+	RGBImage inputImage;
+	
+	/* a frame read still compressed, with roiDecode; inputImage then holds only the region decoded */
+	std::vector<unsigned char> jpeg;
+	int decoded[4];            // that region: x0, y0, x1, y1
+	RGBImage coarse;           // the whole frame decoded faceScale times smaller, for the face search
+	RGBImage outputImage;      // input with the face and eye boxes drawn
+	RGBImage face;             // skin mask
+	RGBImage finalOutputImage;
+	RGBImage eye[2];           // segmented eye before the direction overlay
+	int eyeCols[2], eyeRows[2];   // size of eye, kept also when it is not rendered
+	RGBImage eyeDirection[2];  // direction indicator of each eye
+	RGBImage eyeResized[2];    // eye with overlay, scaled for display
+	int area[2];               // bounding box area of each pupil
+	
+	/* what the in-order commit needs for the blink calibration */
+	int notBlink[2];           // iris pixels found
+	int eyeFound[2];           // eye boundary found
+	int pupilHeight[2], eyeHeight[2];
+	int pupilBlack[2];         // pupil pixels painted into eye
+	int pupilBox[2][4], eyeBox[2][4];   // in the frame: x, y, width, height; 0 size if not found
+	
+	/* black pixels painted into eye, so eyeMovement does not have to scan for them */
+	int eyeBlack[2];
+	long momentX[2], momentY[2];
+	
+	int isStatic;              // the analysis was copied from the last analyzed frame
+	int level;                 // what is rendered and written for the frame, the outputLevel of its session unless the real-time driver lowers it
+	
+	/* what finalOutputImage holds from the last frame composed into it, see composeFrame */
+	int composed;              // the layout of the session
+	int graphColumns;          // graph columns copied, -1 when the graph has scrolled
+	int composedEye[2][4];     // rectangles of the eyes
+	
+	FrameResult() : index(-1), level(OUTPUT_FINAL), composed(0) {}
+};
+
+/* Face box of the previous frame, for tracking, and the last analysis for static frames */
+struct FaceTrack {
+	int found, x, y, w, h;
+	std::vector<int> blocks;   // gray sums of the 8x8 blocks of the face box of the last analyzed frame
+	FrameResult last;          // and its analysis
+	FaceTrack() : found(0), x(0), y(0), w(0), h(0) {}
+};
+
+/* Lighting conditions tried by a sweep, in the order of setLighting */
+#define NUM_PRESETS 5
+extern const char * presetNames[NUM_PRESETS];
+
+/* Analysis of one frame, and the kernels that the benchmark times */
+int findFaceBox(TilePool * tilePool, FrameScratch & scratch, FrameResult & result, int x0, int y0, int x1, int y1, int coarse, int & startX, int & startY, int & w, int & h);
+void detectEye(Session & s, FrameScratch & scratch, RGBImage & inputImage, RGBImage & outputImage, FrameResult & result, int startRow2X, int startRow2Y, int w, int h);
+void analyzeFrame(Session & s, FrameScratch & scratch, FrameResult & result, FaceTrack & track);
+void centerOfMass(Session & s, RGBImage & eye, int counterBlack, long momentx, long momenty, int render);
+void scaleRGB( RGBImage & outputImage, const RGBImage & inputImage);
+
+/* Sessions */
+int setLighting(Session & s, int lighting);
+int nameSession(Session & s, const char * input, const char * sub);
+void makeOutputFolders(Session & s);
+void runPipeline(Session & s);
+void runSession(Session & s);
+void runRealtime(Session & s);
+void runSweep(Session ** presets);
+void printSummary(Session & s);
+void printSweepSummary(Session ** presets);
+int renderTimeline(const char * logFile, const char * jpegFile);
+
+#endif
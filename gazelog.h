@@ -0,0 +1,193 @@
+/*
+    Gaze log: the classification of every frame, one fixed-size record per
+    frame and eye, appended in frame order to <output>/gaze.log.
+    The file is a 16-byte header followed by the records, little-endian and
+    without padding, so a reader can map it and use it as an array:
+        char     magic[8]      "GAZELOG"
+        int32    recordSize    sizeof(GazeRecord), 32
+        int32    version       1
+        GazeRecord records[]   two per frame, eye 0 then eye 1
+    A GazeLogView is such a reader; it sees the records written when it was
+    opened, and refresh() maps those appended since, so it can also follow a
+    session that is still running. The log is not buffered: the records of a
+    frame go to the file in one write at their offset, so a reader sees them
+    as soon as they are appended, and never half of them.
+*/
+
+#ifndef GAZELOG_H
+#define GAZELOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum GazeFlags {
+	GAZE_BLINK = 1,        // no pupil: the eye is closed
+	GAZE_SELECTED = 2,     // the eye with the larger pupil, whose direction is counted in the summary
+	GAZE_STATIC = 4,       // the analysis was reused from an earlier frame
+	GAZE_IRIS = 8,         // an iris was found
+	GAZE_EYE = 16          // the eye boundary was found
+};
+
+/* Direction cells, row-major over the 3x3 grid of the eye */
+enum GazeCell {
+	CELL_NONE = -1,        // blink
+	CELL_UPPER_LEFT, CELL_UP, CELL_UPPER_RIGHT,
+	CELL_LEFT, CELL_CENTER, CELL_RIGHT,
+	CELL_LOWER_LEFT, CELL_LOW, CELL_LOWER_RIGHT
+};
+
+struct GazeRecord {
+	int32_t frame;
+	int32_t black;            // black pixels of the eye image, the pupil as painted into it
+	int16_t centerX, centerY; // pupil centroid in the eye image, -1 on a blink
+	int16_t pupil[4];         // pupil box in the frame: x, y, width, height; 0 size if none
+	int16_t eye[4];           // eye box in the frame
+	int8_t eyeNum;            // 0 or 1, left and right half of the face in the image
+	int8_t cell;              // GazeCell
+	uint8_t flags;            // GazeFlags
+	uint8_t unused;
+};
+
+static const char gazeMagic[8] = "GAZELOG";
+
+class GazeLog {
+public:
+	GazeLog() : fd(-1), offset(0) {}
+	~GazeLog(){ close(); }
+
+	bool open(const char * filename){
+		char header[16];
+		int32_t fields[2] = { (int32_t)sizeof(GazeRecord), 1 };
+		fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd<0)
+			return false;
+		memcpy(header, gazeMagic, 8);
+		memcpy(header+8, fields, sizeof(fields));
+		offset = 0;
+		if(!put(header, sizeof(header))){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void append(const GazeRecord * records, int n){
+		if(fd>=0)
+			put(records, sizeof(GazeRecord)*n);
+	}
+
+	void close(){
+		if(fd>=0){
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+private:
+	/* write at the end of what was written so far; false on an error */
+	bool put(const void * bytes, size_t size){
+		const char * p = (const char *)bytes;
+		while(size>0){
+			ssize_t n = pwrite(fd, p, size, offset);
+			if(n<0 && errno==EINTR)
+				continue;
+			if(n<=0)
+				return false;
+			p += n;
+			size -= n;
+			offset += n;
+		}
+		return true;
+	}
+
+	int fd;
+	off_t offset;
+};
+
+class GazeLogView {
+public:
+	GazeLogView() : fd(-1), data(NULL), bytes(0), records(NULL), count(0) {}
+	~GazeLogView(){ close(); }
+
+	/* map a log; false if it cannot be read or is not a gaze log */
+	bool open(const char * filename){
+		close();
+		fd = ::open(filename, O_RDONLY);
+		if(fd<0)
+			return false;
+		if(!map()){
+			close();
+			return false;
+		}
+		const char * header = (const char *)data;
+		int32_t recordSize;
+		memcpy(&recordSize, header+8, 4);
+		if(memcmp(header, gazeMagic, 8)!=0 || recordSize!=(int32_t)sizeof(GazeRecord)){
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	/* map the records appended since open or the last refresh, for a log that is still written; false on error */
+	bool refresh(){
+		struct stat info;
+		if(fd<0 || fstat(fd, &info)<0)
+			return false;
+		if((size_t)info.st_size==bytes)
+			return true;
+		munmap(data, bytes);
+		data = NULL;
+		records = NULL;
+		count = 0;
+		return map();
+	}
+
+	void close(){
+		if(data)
+			munmap(data, bytes);
+		if(fd>=0)
+			::close(fd);
+		fd = -1;
+		data = NULL;
+		bytes = 0;
+		records = NULL;
+		count = 0;
+	}
+
+	/* number of whole records mapped */
+	int size() const { return count; }
+	const GazeRecord & operator[](int i) const { return records[i]; }
+
+private:
+	/* Function to map the whole file as it is now */
+	bool map(){
+		struct stat info;
+		if(fstat(fd, &info)<0 || info.st_size<16)
+			return false;
+		bytes = info.st_size;
+		data = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+		if(data==MAP_FAILED){
+			data = NULL;
+			bytes = 0;
+			return false;
+		}
+		records = (const GazeRecord *)((const char *)data+16);
+		count = (int)((bytes-16)/sizeof(GazeRecord));
+		return true;
+	}
+
+	int fd;              // kept open to find the size of the log on a refresh
+	void * data;
+	size_t bytes;
+	const GazeRecord * records;
+	int count;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+    Percentile (median) filter for 8-bit images using a sliding histogram (Huang).
+    The histogram of the window is updated by one column of 2r+1 pixels per step
+    along a row, and the requested rank is found by moving from the value of the
+    previous pixel, so the cost per pixel grows with the filter radius r instead
+    of sorting (2r+1)^2 samples.
+
+    Same arguments as orderStatFilter: an odd filter width and a percentile in
+    0..100, where the result is the sample of rank (n-1)*percentile/100 out of
+    the n samples of the window. Pixels outside the image repeat the nearest
+    edge pixel. out must not be the same image as in. Works on Image<unsigned char>
+    and on Plane<unsigned char>.
+    percentileFilterColumns filters only the columns [x0,x1) into an out of the
+    size of in, leaving its other columns as they are, and percentileFilterBlock
+    only the rows [y0,y1) of those columns. Each row only reads in, so the rows
+    of an image can be filtered in bands on several threads.
+*/
+
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include "image.h"
+
+template <class Mask>
+inline void percentileFilterBlock(const Mask & in, Mask & out, int filterWidth, int percentile, int x0, int x1, int y0, int y1){
+	int width = in.width(), height = in.height();
+	int r = filterWidth/2;
+	int n = (2*r+1)*(2*r+1);
+	int rank = (n-1)*percentile/100;
+	int hist[256];
+	int x, y, dx, dy, v, m, below;
+
+	if(x0>=x1)
+		return;
+	for(y=y0; y<y1; y++){
+		// histogram of the window at the start of the row
+		for(v=0; v<256; v++)
+			hist[v] = 0;
+		for(dy=-r; dy<=r; dy++){
+			int yy = y+dy < 0 ? 0 : (y+dy >= height ? height-1 : y+dy);
+			for(dx=x0-r; dx<=x0+r; dx++){
+				int xx = dx < 0 ? 0 : (dx >= width ? width-1 : dx);
+				hist[in(xx,yy)]++;
+			}
+		}
+		m = 0;
+		below = 0;   // samples smaller than m
+
+		for(x=x0; x<x1; x++){
+			if(x>x0){
+				int xOut = x-1-r < 0 ? 0 : x-1-r;
+				int xIn = x+r >= width ? width-1 : x+r;
+				for(dy=-r; dy<=r; dy++){
+					int yy = y+dy < 0 ? 0 : (y+dy >= height ? height-1 : y+dy);
+					v = in(xOut,yy);
+					hist[v]--;
+					if(v<m) below--;
+					v = in(xIn,yy);
+					hist[v]++;
+					if(v<m) below++;
+				}
+			}
+			// move m to the value holding the rank
+			while(below>rank){
+				m--;
+				below -= hist[m];
+			}
+			while(below+hist[m]<=rank){
+				below += hist[m];
+				m++;
+			}
+			out(x,y) = m;
+		}
+	}
+}
+
+template <class Mask>
+inline void percentileFilterColumns(const Mask & in, Mask & out, int filterWidth, int percentile, int x0, int x1){
+	percentileFilterBlock(in, out, filterWidth, percentile, x0, x1, 0, in.height());
+}
+
+template <class Mask>
+inline void percentileFilter(const Mask & in, Mask & out, int filterWidth, int percentile){
+	out.resize(in.width(), in.height());
+	percentileFilterColumns(in, out, filterWidth, percentile, 0, in.width());
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+    Morphology with rectangular structuring elements.
+    A rectangle is separable, so each operation is a running max (dilation)
+    or min (erosion) along the rows followed by one along the columns.
+    Each running max/min uses the van Herk/Gil-Werman algorithm: the line is
+    cut into blocks of the window length, and a window is then the max of a
+    block suffix and the next block prefix. That costs about three comparisons
+    per pixel and pass, whatever the size of the element.
+
+    The element is sw x sh with its origin at (ox,oy), the same arguments as
+    binaryDilation/binaryErosion with an all-ones element. Pixels outside the
+    image are ignored, as in those functions. The output may be the input image.
+    The images can be Image<unsigned char> or Plane<unsigned char>; the working
+    lines are kept between calls, so a RectMorphology that is reused does not
+    allocate once it has seen the largest image.
+    A BitMask is filtered a word, 64 pixels, at a time instead: the OR (AND)
+    of a window of k pixels is built by doubling, OR-ing the line with itself
+    shifted by 1, 2, 4, ... pixels, so a row costs about log2(k) word shifts per
+    64 pixels, and the columns are the same on whole rows of words.
+*/
+
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <vector>
+#include <algorithm>
+#include "image.h"
+#include "bitmask.h"
+
+class RectMorphology {
+public:
+	template <class Mask>
+	void dilate(const Mask & in, Mask & out, int sw, int sh, int ox, int oy){
+		filter(in, out, sw, sh, ox, oy, true);
+	}
+
+	template <class Mask>
+	void erode(const Mask & in, Mask & out, int sw, int sh, int ox, int oy){
+		filter(in, out, sw, sh, ox, oy, false);
+	}
+
+	/* dilation followed by erosion */
+	template <class Mask>
+	void close(const Mask & in, Mask & out, int sw, int sh, int ox, int oy){
+		filter(in, out, sw, sh, ox, oy, true);
+		filter(out, out, sw, sh, ox, oy, false);
+	}
+
+	/* erosion followed by dilation */
+	template <class Mask>
+	void open(const Mask & in, Mask & out, int sw, int sh, int ox, int oy){
+		filter(in, out, sw, sh, ox, oy, false);
+		filter(out, out, sw, sh, ox, oy, true);
+	}
+
+	/* the same on bit-packed masks */
+	void dilate(const BitMask & in, BitMask & out, int sw, int sh, int ox, int oy){
+		filterBits(in, out, sw, sh, ox, oy, true);
+	}
+	void erode(const BitMask & in, BitMask & out, int sw, int sh, int ox, int oy){
+		filterBits(in, out, sw, sh, ox, oy, false);
+	}
+	void close(const BitMask & in, BitMask & out, int sw, int sh, int ox, int oy){
+		filterBits(in, out, sw, sh, ox, oy, true);
+		filterBits(out, out, sw, sh, ox, oy, false);
+	}
+	void open(const BitMask & in, BitMask & out, int sw, int sh, int ox, int oy){
+		filterBits(in, out, sw, sh, ox, oy, false);
+		filterBits(out, out, sw, sh, ox, oy, true);
+	}
+
+private:
+	/* running max (or min) over the window [x-before, x+after] of line[0..n) */
+	void runLine(const unsigned char * line, unsigned char * result, int n, int before, int after, bool max){
+		int k = before+after+1;
+		int len = n+before+after;
+		unsigned char neutral = max ? 0 : 255;
+
+		padded.resize(len);
+		prefix.resize(len);
+		suffix.resize(len);
+		for(int i=0; i<len; i++)
+			padded[i] = (i<before || i>=before+n) ? neutral : line[i-before];
+
+		for(int i=0; i<len; i++)
+			prefix[i] = (i%k==0) ? padded[i] : pick(prefix[i-1], padded[i], max);
+		for(int i=len-1; i>=0; i--)
+			suffix[i] = (i%k==k-1 || i==len-1) ? padded[i] : pick(suffix[i+1], padded[i], max);
+
+		for(int x=0; x<n; x++)
+			result[x] = pick(suffix[x], prefix[x+k-1], max);
+	}
+
+	static unsigned char pick(unsigned char a, unsigned char b, bool max){
+		return max ? std::max(a,b) : std::min(a,b);
+	}
+
+	template <class Mask>
+	void filter(const Mask & in, Mask & out, int sw, int sh, int ox, int oy, bool max){
+		int width = in.width(), height = in.height();
+		int x, y;
+
+		rows.resize((size_t)width*height);
+		line.resize(std::max(width, height));
+		column.resize(std::max(width, height));
+
+		// along the rows
+		for(y=0; y<height; y++){
+			for(x=0; x<width; x++)
+				line[x] = in(x,y);
+			runLine(&line[0], &rows[(size_t)y*width], width, sw-1-ox, ox, max);
+		}
+
+		// along the columns
+		out.resize(width, height);
+		for(x=0; x<width; x++){
+			for(y=0; y<height; y++)
+				line[y] = rows[(size_t)y*width+x];
+			runLine(&line[0], &column[0], height, sh-1-oy, oy, max);
+			for(y=0; y<height; y++)
+				out(x,y) = column[y];
+		}
+	}
+
+	/* dst(x) = src(x+s) for the n words of dst, with fill outside the m words of src */
+	static void shiftBits(const uint64_t * src, int m, uint64_t * dst, int n, int s, uint64_t fill){
+		int q = s>=0 ? s/64 : -((-s+63)/64);   // floor division
+		int r = s-q*64;
+		for(int k=0; k<n; k++){
+			int a = k+q;
+			uint64_t lo = (a>=0 && a<m) ? src[a] : fill;
+			uint64_t hi = (a+1>=0 && a+1<m) ? src[a+1] : fill;
+			dst[k] = r ? (lo >> r | hi << (64-r)) : lo;
+		}
+	}
+
+	/* acc(x) = OR (AND) of line(x..x+k-1), in place on n words */
+	void spanBits(uint64_t * acc, int n, int k, bool max){
+		uint64_t fill = max ? 0 : ~(uint64_t)0;
+		int span = 1;
+		shifted.resize(n);
+		while(span<k){
+			int step = std::min(span, k-span);
+			shiftBits(acc, n, &shifted[0], n, step, fill);
+			for(int i=0; i<n; i++)
+				acc[i] = max ? (acc[i] | shifted[i]) : (acc[i] & shifted[i]);
+			span += step;
+		}
+	}
+
+	void filterBits(const BitMask & in, BitMask & out, int sw, int sh, int ox, int oy, bool max){
+		int width = in.width(), height = in.height(), words = in.wordsPerRow();
+		int before = sh-1-oy;
+		uint64_t fill = max ? 0 : ~(uint64_t)0;
+		uint64_t tail = in.tailMask();
+		int y, k;
+
+		// along the rows, into the padded column buffer: sh-1-oy rows of fill above, oy below
+		int len = height+sh-1;
+		int lineWords = (width+sw-1+63)/64;   // a row with sw-1-ox pixels of fill before it and ox after
+		bitRows.resize((size_t)len*words);
+		bitLine.resize(lineWords);
+		maskedRow.resize(words);
+		std::fill(bitRows.begin(), bitRows.begin()+(size_t)before*words, fill);
+		std::fill(bitRows.begin()+(size_t)(before+height)*words, bitRows.begin()+(size_t)len*words, fill);
+		for(y=0; y<height; y++){
+			uint64_t * r = &bitRows[(size_t)(before+y)*words];
+			std::copy(in.row(y), in.row(y)+words, &maskedRow[0]);
+			if(words && !max)
+				maskedRow[words-1] |= tail;     // pixels past the width are ignored
+			shiftBits(&maskedRow[0], words, &bitLine[0], lineWords, -(sw-1-ox), fill);
+			spanBits(&bitLine[0], lineWords, sw, max);
+			std::copy(&bitLine[0], &bitLine[0]+words, r);
+		}
+
+		// along the columns: the same doubling on whole rows
+		int span = 1;
+		while(span<sh){
+			int step = std::min(span, sh-span);
+			for(y=0; y+step<len; y++){
+				uint64_t * a = &bitRows[(size_t)y*words];
+				const uint64_t * b = &bitRows[(size_t)(y+step)*words];
+				for(k=0; k<words; k++)
+					a[k] = max ? (a[k] | b[k]) : (a[k] & b[k]);
+			}
+			span += step;
+		}
+
+		out.resize(width, height);
+		for(y=0; y<height; y++){
+			std::copy(&bitRows[(size_t)y*words], &bitRows[(size_t)y*words]+words, out.row(y));
+			out.clearTail(out.row(y));
+		}
+	}
+
+	std::vector<unsigned char> rows, line, column, padded, prefix, suffix;
+	std::vector<uint64_t> bitRows, bitLine, maskedRow, shifted;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*
+    Bounded blocking queue used to connect the stages of the frame pipeline.
+    push() blocks while the queue is full and pop() blocks while it is empty;
+    after close() the remaining items can still be popped, then pop() returns false.
+*/
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+template <class T>
+class BoundedQueue {
+public:
+	BoundedQueue(int capacity) : capacity(capacity), closed(false) {}
+
+	void push(const T & item){
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this]{ return (int)items.size() < capacity || closed; });
+		items.push_back(item);
+		notEmpty.notify_one();
+	}
+
+	bool pop(T & item){
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this]{ return !items.empty() || closed; });
+		if(items.empty())
+			return false;
+		item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close(){
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	int capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable notFull, notEmpty;
+};
+
+#endif
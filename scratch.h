@@ -0,0 +1,94 @@
+/*
+    Scratch buffers of the frame analysis.
+    A Plane is a row-major image that keeps its memory when it is resized:
+    it only allocates when it grows past the largest size it has held, so
+    after the first frames of a clip resizing it costs nothing.
+    A FrameScratch holds every buffer that detectFace and detectEye need. One
+    is owned by each analysis thread of a session and reused for all of its
+    frames, so the steady state of the analysis does not allocate.
+    The two eyes of a frame are searched concurrently, each in its own
+    EyeScratch, and a mask split into row bands on the tile pool gives each
+    band its own BandScratch.
+*/
+
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <vector>
+#include <algorithm>
+#include "image.h"
+#include "bitmask.h"
+#include "morphology.h"
+#include "components.h"
+
+template <class T>
+class Plane {
+public:
+	Plane() : w(0), h(0) {}
+
+	void resize(int width, int height){
+		w = width;
+		h = height;
+		if(pixels.size() < (size_t)w*h)
+			pixels.resize((size_t)w*h);
+	}
+
+	int width() const { return w; }
+	int height() const { return h; }
+	T & operator()(int x, int y) { return pixels[(size_t)y*w+x]; }
+	const T & operator()(int x, int y) const { return pixels[(size_t)y*w+x]; }
+
+	void setAll(T value){
+		std::fill(pixels.begin(), pixels.begin()+(size_t)w*h, value);
+	}
+
+private:
+	std::vector<T> pixels;
+	int w, h;
+};
+
+/* buffers of one row band of a mask */
+struct BandScratch {
+	BitMask mask;                         // the rows of the band with their halo
+	RectMorphology morph;
+	std::vector<unsigned char> lineMask;
+	std::vector<unsigned int> level;      // a row of the reduced frame
+	float max[3];                         // largest Y, Cr and Cb of the rows of the band
+};
+
+/* buffers of the search of one eye */
+struct EyeScratch {
+	BitMask binary, binary1;
+	Plane<unsigned char> gray, median;
+	ComponentLabeller cc;
+	std::vector<BandScratch> bands;
+};
+
+struct FrameScratch {
+	/* face search */
+	BitMask skin;
+	Plane<float> Y, Cr, Cb;
+	std::vector<float> lineY, lineCr, lineCb;
+	std::vector<unsigned char> lineMask;  // a threshold row, before it is packed into a BitMask
+	std::vector<int> lineCount;           // longest skin run per line of an edge strip
+	std::vector<int> lineRun;             // skin run ending at the current row, per column of a strip
+
+	/* static frame detection */
+	std::vector<unsigned char> lineGray;
+	std::vector<int> blockSums;
+
+	/* eye search */
+	EyeScratch eyes[2];
+	
+	/* gray image and median of the whole band of each eye, shared by the presets of a sweep */
+	Plane<unsigned char> bandGray[2], bandMedian[2];
+	int sharedBands;          // detectEye takes its median from these
+	RGBImage sample;          // masks written at OUTPUT_DEBUG
+
+	ComponentLabeller cc;
+	std::vector<BandScratch> bands;       // row bands of the face search
+
+	FrameScratch() : sharedBands(0) {}
+};
+
+#endif
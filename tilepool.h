@@ -0,0 +1,139 @@
+/*
+    Fork-join pool for the tiles of one frame.
+    run(n, task) calls task(0) .. task(n-1) on the threads of the pool and on
+    the calling thread, and returns when all of them have finished. The caller
+    takes tasks of its own run as the pool threads do, so a run always makes
+    progress, even when every pool thread is busy with other runs and when a
+    task itself calls run (an eye whose masks are split into row bands).
+    Unlike WorkPool::wait, which waits for everything submitted to the pool, a
+    run only waits for its own tasks, so all the analysis threads of a process
+    can share one pool.
+    bandRows splits the rows of an image into bands of at least minRows rows,
+    one per thread at most.
+*/
+
+#ifndef TILEPOOL_H
+#define TILEPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+class TilePool {
+public:
+	typedef std::function<void(int)> Task;
+
+	TilePool(int numThreads) : stop(false) {
+		for(int t=0; t<numThreads; t++)
+			threads.push_back(std::thread(&TilePool::work, this));
+	}
+
+	~TilePool(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for(size_t t=0; t<threads.size(); t++)
+			threads[t].join();
+	}
+
+	/* threads that run tasks, the caller included */
+	int size() const { return (int)threads.size()+1; }
+
+	void run(int n, const Task & task){
+		if(n<=1 || threads.empty()){
+			for(int i=0; i<n; i++)
+				task(i);
+			return;
+		}
+		Job job(&task, n);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(&job);
+		}
+		wake.notify_all();
+		runTasks(job);
+
+		// the other tasks may still run on pool threads
+		std::unique_lock<std::mutex> lock(mutex);
+		retire(&job);
+		done.wait(lock, [&job]{ return job.left==0 && job.users==0; });
+	}
+
+	/* Function to get the rows [y0,y1) of band b out of bands */
+	static void bandRange(int height, int bands, int b, int & y0, int & y1){
+		y0 = (int)((long)height*b/bands);
+		y1 = (int)((long)height*(b+1)/bands);
+	}
+
+	/* number of bands of at least minRows rows, at most one per thread of the pool */
+	static int bandRows(const TilePool * pool, int height, int minRows){
+		if(!pool)
+			return 1;
+		return std::max(1, std::min(pool->size(), height/minRows));
+	}
+
+private:
+	struct Job {
+		const Task * task;
+		int n, next, left, users;   // tasks, the next to start, those not finished, pool threads inside it
+		Job(const Task * task, int n) : task(task), n(n), next(0), left(n), users(0) {}
+	};
+
+	/* Function to run tasks of a job until none is left to start */
+	void runTasks(Job & job){
+		while(true){
+			int i;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(job.next>=job.n)
+					return;
+				i = job.next++;
+			}
+			(*job.task)(i);
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--job.left==0)
+				done.notify_all();
+		}
+	}
+
+	/* Function to take a job whose tasks have all started off the list; the mutex is held */
+	void retire(Job * job){
+		std::deque<Job *>::iterator it = std::find(jobs.begin(), jobs.end(), job);
+		if(it!=jobs.end())
+			jobs.erase(it);
+	}
+
+	void work(){
+		while(true){
+			Job * job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]{ return stop || !jobs.empty(); });
+				if(jobs.empty())
+					return;
+				job = jobs.front();
+				job->users++;
+			}
+			runTasks(*job);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			retire(job);
+			if(--job->users==0)
+				done.notify_all();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<Job *> jobs;
+	bool stop;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*
+    Per-stage latency tracing.
+    A StageTimer measures the scope it lives in, or up to its stop(), and records
+    it for the frame that the current thread works on, as set by a TraceFrame.
+    When no tracer is set for the thread, a timer costs one thread-local load
+    and a branch.
+    The Tracer streams every timing to a Chrome trace-event JSON file (open it
+    in chrome://tracing or Perfetto), and the per-frame total of each stage to
+    a CSV file, and reports the p50/p95/p99 of each stage over the frames.
+    A LatencyHistogram gives such percentiles in a fixed size, whatever the
+    number of values it is given.
+    Only the frames in flight are held: once endFrame says a frame is done and
+    the frames before it are too, it is written out and counted in the
+    histograms, so the memory of a trace does not grow with the stream.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+enum TraceStage {
+	STAGE_DECODE,
+	STAGE_SKIN,          // skin classification of the face search
+	STAGE_MORPHOLOGY,    // face and eye masks
+	STAGE_COMPONENTS,    // labelling and picking of the face, iris and eye
+	STAGE_MEDIAN,
+	STAGE_IRIS,          // gray conversion and iris threshold
+	STAGE_EYE_BOUNDARY,  // eye threshold
+	STAGE_DIRECTION,     // eyeMovement
+	STAGE_COMPOSE,
+	STAGE_ENCODE,
+	NUM_STAGES
+};
+
+static const char * stageNames[NUM_STAGES] = { "decode", "skin", "morphology", "components", "median",
+	"iris", "eyeBoundary", "direction", "compose", "encode" };
+
+typedef std::chrono::steady_clock TraceClock;
+
+/*
+    Durations in ms counted on a log scale, 100 buckets per decade from 1 us to 100 s: a percentile is
+    the upper edge of the bucket it falls in, within 2.3% of the value, and the memory stays the same
+    however long the stream.
+*/
+class LatencyHistogram {
+public:
+	enum { PER_DECADE = 100, BUCKETS = 8*PER_DECADE };
+
+	LatencyHistogram() : counts(BUCKETS, 0), total(0), largest(0) {}
+
+	void add(double ms){
+		int b = ms>0.001 ? (int)(log10(ms/0.001)*PER_DECADE) : 0;
+		counts[std::min(b, (int)BUCKETS-1)]++;
+		total++;
+		largest = std::max(largest, ms);
+	}
+
+	long size() const { return total; }
+	double max() const { return largest; }
+
+	/* percentile p by nearest rank */
+	double percentile(int p) const {
+		long rank = std::max(1L, (total*p+99)/100), n = 0;
+		for(int b=0; b<BUCKETS; b++){
+			n += counts[b];
+			if(n>=rank)
+				return std::min(largest, 0.001*pow(10, (b+1)/(double)PER_DECADE));
+		}
+		return largest;
+	}
+
+private:
+	std::vector<long> counts;
+	long total;
+	double largest;
+};
+
+class Tracer {
+public:
+	Tracer() : file(NULL), csv(NULL), events(0), nextRow(0), origin(TraceClock::now()), stages(NUM_STAGES+1) {}
+	~Tracer(){ close(); }
+
+	/* Function to open the trace file, and the per-frame table when csvFile is given */
+	bool open(const char * jsonFile, const char * csvFile){
+		file = fopen(jsonFile, "w");
+		if(!file)
+			return false;
+		fprintf(file, "{\"traceEvents\":[\n");
+		if(csvFile){
+			csv = fopen(csvFile, "w");
+			if(!csv)
+				return false;
+			fprintf(csv, "frame");
+			for(int k=0; k<NUM_STAGES; k++)
+				fprintf(csv, ",%s", stageNames[k]);
+			fprintf(csv, ",total\n");
+		}
+		return true;
+	}
+
+	void record(int stage, int frame, TraceClock::time_point start, TraceClock::time_point end){
+		double us = std::chrono::duration<double, std::micro>(start-origin).count();
+		double duration = std::chrono::duration<double, std::micro>(end-start).count();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(frame>=nextRow){
+			std::vector<double> & times = frames[frame];
+			if(times.empty())
+				times.resize(NUM_STAGES, 0);
+			times[stage] += duration;
+		}
+		if(file)
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%d}}",
+				events++ ? ",\n" : "", stageNames[stage], us, duration, threadNumber(), frame);
+	}
+
+	/* Function to mark a frame as done, no more stages of it will be timed */
+	void endFrame(int frame){
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<int, std::vector<double> >::iterator it = frames.find(frame);
+		if(it==frames.end())
+			return;
+		it->second.push_back(1);   // done mark, after the stages
+		while(!frames.empty() && (int)frames.begin()->second.size()>NUM_STAGES)
+			retire();
+	}
+
+	/* Function to end the trace file, and write out the frames still held */
+	void close(){
+		std::lock_guard<std::mutex> lock(mutex);
+		while(!frames.empty())
+			retire();
+		if(file){
+			fprintf(file, "\n]}\n");
+			fclose(file);
+			file = NULL;
+		}
+		if(csv){
+			fclose(csv);
+			csv = NULL;
+		}
+	}
+
+	/* Function to display the percentiles of each stage over the frames it ran on, after close */
+	void printLatencies(){
+		printf("\n Stage latency per frame (ms):\n");
+		printf("\n   %-12s |  %8s  %8s  %8s", "Stage", "p50", "p95", "p99");
+		for(int k=0; k<=NUM_STAGES; k++){
+			if(stages[k].size()==0)
+				continue;
+			printf("\n   %-12s |  %8.3f  %8.3f  %8.3f", k<NUM_STAGES ? stageNames[k] : "total",
+				stages[k].percentile(50), stages[k].percentile(95), stages[k].percentile(99));
+		}
+		printf("\n");
+	}
+
+private:
+	/* Function to write the oldest frame held to the table, after empty rows for the frames before it that were not timed, and count it in the histograms */
+	void retire(){
+		std::map<int, std::vector<double> >::iterator oldest = frames.begin();
+		std::vector<double> & times = oldest->second;
+		double total = 0;
+
+		for(; csv && nextRow<oldest->first; nextRow++){
+			fprintf(csv, "%d", nextRow);
+			for(int k=0; k<=NUM_STAGES; k++)
+				fprintf(csv, ",%.3f", 0.0);
+			fprintf(csv, "\n");
+		}
+		if(csv)
+			fprintf(csv, "%d", oldest->first);
+		for(int k=0; k<NUM_STAGES; k++){
+			if(csv)
+				fprintf(csv, ",%.3f", times[k]/1000);
+			if(times[k]>0)
+				stages[k].add(times[k]/1000);
+			total += times[k];
+		}
+		if(csv)
+			fprintf(csv, ",%.3f\n", total/1000);
+		if(total>0)
+			stages[NUM_STAGES].add(total/1000);
+		nextRow = oldest->first+1;
+		frames.erase(oldest);
+	}
+
+	int threadNumber(){
+		std::map<std::thread::id, int>::iterator it = threads.find(std::this_thread::get_id());
+		if(it!=threads.end())
+			return it->second;
+		int n = (int)threads.size()+1;
+		threads[std::this_thread::get_id()] = n;
+		return n;
+	}
+
+	FILE * file, * csv;
+	int events;
+	int nextRow;   // first frame not yet written out
+	TraceClock::time_point origin;
+	std::map<int, std::vector<double> > frames;   // microseconds per stage of the frames held
+	std::vector<LatencyHistogram> stages;         // ms per frame of each stage, and of all of them
+	std::map<std::thread::id, int> threads;
+	std::mutex mutex;
+};
+
+/* Tracer and frame of the calling thread */
+struct TraceContext {
+	Tracer * tracer;
+	int frame;
+};
+
+inline TraceContext & traceContext(){
+	static thread_local TraceContext context = { NULL, 0 };
+	return context;
+}
+
+/* Sets the frame traced by the calling thread for the scope it lives in */
+class TraceFrame {
+public:
+	TraceFrame(Tracer * tracer, int frame) : saved(traceContext()) {
+		traceContext().tracer = tracer;
+		traceContext().frame = frame;
+	}
+	~TraceFrame(){
+		traceContext() = saved;
+	}
+private:
+	TraceContext saved;
+};
+
+/* Times its scope as one stage of the traced frame */
+class StageTimer {
+public:
+	StageTimer(int stage) : stage(stage) {
+		TraceContext & context = traceContext();
+		tracer = context.tracer;
+		if(tracer){
+			frame = context.frame;
+			start = TraceClock::now();
+		}
+	}
+	~StageTimer(){
+		stop();
+	}
+	/* end the stage before the end of the scope */
+	void stop(){
+		if(tracer)
+			tracer->record(stage, frame, start, TraceClock::now());
+		tracer = NULL;
+	}
+private:
+	Tracer * tracer;
+	int stage, frame;
+	TraceClock::time_point start;
+};
+
+#endif
@@ -0,0 +1,696 @@
+/*
+    Frame sources for the analysis.
+    A source hands out the frames of a clip one at a time until the clip ends,
+    so the number of frames comes from the input itself:
+      - JpegFolderSource reads images/SP/input/<folder>/0.jpg, 1.jpg, ... up to the first missing file
+      - Y4MSource reads an uncompressed YUV4MPEG2 stream (4:2:0, 4:2:2, 4:4:4 or mono, 8 bits)
+      - MJPEGSource reads concatenated JPEG frames
+    The streams can come from a file or from stdin ("-"), e.g.
+        ffmpeg -i clip.mp4 -f yuv4mpegpipe - | main 3 -
+    The JPEG sources can also hand out their frames still compressed (readEncoded),
+    for the analysis to decode only what it reads of them with decodeJpeg: a region
+    of rows and columns, at full size or reduced by the inverse DCT.
+    PrefetchSource decodes ahead of the analysis on its own thread into a bounded buffer.
+    TimedSource traces the decode time of each frame.
+    LiveSource is the capture of the real-time driver: it keeps only the newest
+    frame, so frames that the analysis has no time for are passed over.
+    A live stream (stdin or a FIFO) is read through an InterruptibleStream, so a
+    thread waiting in it for the next frame can be stopped with interrupt().
+*/
+
+#ifndef VIDEOIN_H
+#define VIDEOIN_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <jpeglib.h>
+#include "image.h"
+#include "jpegio.h"
+#include "queue.h"
+#include "trace.h"
+
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+	/* read the next frame; false at the end of the clip */
+	virtual bool read(RGBImage & frame) = 0;
+	/* the frames are JPEG and can be read still compressed */
+	virtual bool encoded() const { return false; }
+	/* read the next frame as the bytes of its JPEG, instead of read; false at the end of the clip */
+	virtual bool readEncoded(std::vector<unsigned char> &) { return false; }
+	/* end the clip of a live stream, also for a read that waits for its next frame on another thread */
+	virtual void interrupt() {}
+};
+
+/* libjpeg error handler that returns to the decoder instead of exiting */
+struct JpegErrorManager {
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+
+	static void onError(j_common_ptr info){
+		longjmp(((JpegErrorManager *)info->err)->jump, 1);
+	}
+};
+
+/* Function to get the size of a JPEG in memory from its header; false if it is not a JPEG */
+inline bool jpegSize(const std::vector<unsigned char> & data, int & width, int & height){
+	jpeg_decompress_struct info;
+	JpegErrorManager error;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = JpegErrorManager::onError;
+	if(data.empty())
+		return false;
+	if(setjmp(error.jump)){
+		jpeg_destroy_decompress(&info);
+		return false;
+	}
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, &data[0], data.size());
+	jpeg_read_header(&info, TRUE);
+	width = info.image_width;
+	height = info.image_height;
+	jpeg_destroy_decompress(&info);
+	return true;
+}
+
+/*
+    Function to decode the region [x0,x1)x[y0,y1) of a JPEG in memory into frame, with the decompressor
+    created; see decodeJpeg. A libjpeg error leaves it by longjmp, so it keeps no state of its own that
+    would need cleaning up: the row buffer belongs to the caller.
+*/
+inline void decodeJpegRegion(jpeg_decompress_struct & info, const std::vector<unsigned char> & data, RGBImage & frame,
+                             std::vector<unsigned char> & row, int denom, int x0, int y0, int x1, int y1){
+	jpeg_mem_src(&info, &data[0], data.size());
+	jpeg_read_header(&info, TRUE);
+	info.out_color_space = JCS_RGB;
+	info.scale_num = 1;
+	info.scale_denom = denom;
+	jpeg_start_decompress(&info);
+
+	int width = info.output_width, height = info.output_height;
+	frame.resize(width, height);
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, width);
+	y1 = std::min(y1, height);
+	if(x0>=x1 || y0>=y1)
+		return;
+
+	int left = 0;   // column of the first pixel of a decoded row
+#ifdef LIBJPEG_TURBO_VERSION
+	if(x0>0 || x1<width){
+		JDIMENSION offset = x0, cropped = x1-x0;
+		jpeg_crop_scanline(&info, &offset, &cropped);
+		left = offset;
+	}
+	if(y0>0)
+		jpeg_skip_scanlines(&info, y0);
+#endif
+	row.resize((size_t)info.output_width*3);
+	while((int)info.output_scanline<y1){
+		int y = info.output_scanline;
+		JSAMPROW rows[1] = { &row[0] };
+		jpeg_read_scanlines(&info, rows, 1);
+		if(y<y0)
+			continue;
+		for(int x=x0; x<x1; x++){
+			const unsigned char * p = &row[3*(x-left)];
+			frame(x,y) = COLOR_RGB(p[0], p[1], p[2]);
+		}
+	}
+	if((int)info.output_scanline==height)
+		jpeg_finish_decompress(&info);
+}
+
+/*
+    Function to decode the region [x0,x1)x[y0,y1) of a JPEG in memory into frame, reduced denom = 1, 2,
+    4 or 8 times by the inverse DCT. The region is in pixels of the reduced image, and frame is sized to
+    all of it; its pixels outside the region keep what they held. The rows above the region are skipped
+    without their inverse DCT and color conversion, the columns beside it are cropped to the nearest
+    iMCU, and the decoding stops after its last row. False if the JPEG is corrupt.
+*/
+inline bool decodeJpeg(const std::vector<unsigned char> & data, RGBImage & frame, int denom = 1,
+                       int x0 = 0, int y0 = 0, int x1 = INT_MAX, int y1 = INT_MAX){
+	jpeg_decompress_struct info;
+	JpegErrorManager error;
+	std::vector<unsigned char> row;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = JpegErrorManager::onError;
+	if(data.empty())
+		return false;
+	if(setjmp(error.jump)){
+		jpeg_destroy_decompress(&info);
+		return false;
+	}
+	jpeg_create_decompress(&info);
+	decodeJpegRegion(info, data, frame, row, denom, x0, y0, x1, y1);
+	jpeg_destroy_decompress(&info);
+	return true;
+}
+
+/* numbered JPEG files of a folder */
+class JpegFolderSource : public FrameSource {
+public:
+	JpegFolderSource(const char * folder) : next(0) {
+		snprintf(this->folder, sizeof(this->folder), "%s", folder);
+	}
+
+	bool read(RGBImage & frame){
+		char filename[300];
+		sprintf(filename, "%s/%d.jpg", folder, next);
+		FILE * file = fopen(filename, "rb");
+		if(!file)
+			return false;
+		fclose(file);
+		readJpeg(frame, filename);
+		next++;
+		return true;
+	}
+
+	bool encoded() const { return true; }
+
+	bool readEncoded(std::vector<unsigned char> & data){
+		char filename[300];
+		sprintf(filename, "%s/%d.jpg", folder, next);
+		FILE * file = fopen(filename, "rb");
+		if(!file)
+			return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		data.resize(size>0 ? size : 0);
+		data.resize(data.empty() ? 0 : fread(&data[0], 1, data.size(), file));
+		fclose(file);
+		next++;
+		return true;
+	}
+
+private:
+	char folder[250];
+	int next;
+};
+
+inline unsigned char clip255(int v){
+	return v<0 ? 0 : (v>255 ? 255 : v);
+}
+
+/* YUV4MPEG2 stream */
+class Y4MSource : public FrameSource {
+public:
+	Y4MSource(FILE * file) : file(file), width(0), height(0), chromaWidth(0), chromaHeight(0), ok(false) {
+		char header[256];
+		if(!readLine(header, sizeof(header)) || strncmp(header, "YUV4MPEG2 ", 10)!=0){
+			fprintf(stderr, "\nNot a YUV4MPEG2 stream");
+			return;
+		}
+		const char * colorspace = "420";
+		for(char * token = strtok(header+10, " "); token; token = strtok(NULL, " ")){
+			if(token[0]=='W') width = atoi(token+1);
+			else if(token[0]=='H') height = atoi(token+1);
+			else if(token[0]=='C') colorspace = token+1;
+		}
+		if(strncmp(colorspace, "420", 3)==0 && !strstr(colorspace, "p1")){     // not 420p10, 420p12, ...
+			chromaWidth = (width+1)/2;
+			chromaHeight = (height+1)/2;
+		}
+		else if(strcmp(colorspace, "422")==0){
+			chromaWidth = (width+1)/2;
+			chromaHeight = height;
+		}
+		else if(strcmp(colorspace, "444")==0){
+			chromaWidth = width;
+			chromaHeight = height;
+		}
+		else if(strcmp(colorspace, "mono")!=0){
+			fprintf(stderr, "\nUnsupported YUV4MPEG2 color space %s", colorspace);
+			return;
+		}
+		ok = width>0 && height>0;
+		luma.resize((size_t)width*height);
+		u.resize((size_t)chromaWidth*chromaHeight);
+		v.resize((size_t)chromaWidth*chromaHeight);
+	}
+
+	bool read(RGBImage & frame){
+		char line[256];
+		if(!ok || !readLine(line, sizeof(line)) || strncmp(line, "FRAME", 5)!=0)
+			return false;
+		if(fread(&luma[0], 1, luma.size(), file)!=luma.size())
+			return false;
+		if(!u.empty() && (fread(&u[0], 1, u.size(), file)!=u.size() || fread(&v[0], 1, v.size(), file)!=v.size()))
+			return false;
+
+		// BT.601 studio range to RGB
+		frame.resize(width, height);
+		for(int y=0; y<height; y++){
+			int cy = y*chromaHeight/height;
+			for(int x=0; x<width; x++){
+				int c = 298*(luma[(size_t)y*width+x]-16);
+				int d = 0, e = 0;
+				if(!u.empty()){
+					int cx = x*chromaWidth/width;
+					d = u[(size_t)cy*chromaWidth+cx]-128;
+					e = v[(size_t)cy*chromaWidth+cx]-128;
+				}
+				frame(x,y) = COLOR_RGB(clip255((c + 409*e + 128) >> 8),
+				                       clip255((c - 100*d - 208*e + 128) >> 8),
+				                       clip255((c + 516*d + 128) >> 8));
+			}
+		}
+		return true;
+	}
+
+private:
+	bool readLine(char * line, int size){
+		int n = 0, ch;
+		while((ch = getc(file))!=EOF && ch!='\n'){
+			if(n<size-1)
+				line[n++] = ch;
+		}
+		line[n] = 0;
+		return ch!=EOF || n>0;
+	}
+
+	FILE * file;
+	int width, height, chromaWidth, chromaHeight;
+	bool ok;
+	std::vector<unsigned char> luma, u, v;
+};
+
+/* concatenated JPEG frames */
+class MJPEGSource : public FrameSource {
+public:
+	MJPEGSource(FILE * file) : file(file) {}
+
+	bool read(RGBImage & frame){
+		while(readJpegBytes()){
+			if(decodeJpeg(data, frame))
+				return true;
+			fprintf(stderr, "\nSkipping a corrupt JPEG frame");
+		}
+		return false;
+	}
+
+	bool encoded() const { return true; }
+
+	bool readEncoded(std::vector<unsigned char> & frame){
+		int width, height;
+		while(readJpegBytes()){
+			if(jpegSize(data, width, height)){
+				frame.swap(data);
+				return true;
+			}
+			fprintf(stderr, "\nSkipping a corrupt JPEG frame");
+		}
+		return false;
+	}
+
+private:
+	/* the bytes of one JPEG, from SOI to EOI */
+	bool readJpegBytes(){
+		int ch, marker;
+		data.clear();
+		if(getc(file)!=0xFF || getc(file)!=0xD8)
+			return false;
+		put(0xFF);
+		put(0xD8);
+
+		marker = nextMarker();
+		while(marker>=0){
+			put(0xFF);
+			put(marker);
+			if(marker==0xD9)             // EOI
+				return true;
+			if(marker==0x01 || (marker>=0xD0 && marker<=0xD7)){
+				marker = nextMarker();
+				continue;
+			}
+			int hi = getc(file), lo = getc(file);
+			if(lo==EOF)
+				return false;
+			put(hi);
+			put(lo);
+			for(int k=(hi<<8 | lo)-2; k>0; k--){
+				if((ch = getc(file))==EOF)
+					return false;
+				put(ch);
+			}
+			if(marker!=0xDA){            // not SOS
+				marker = nextMarker();
+				continue;
+			}
+			// entropy-coded data runs up to the next marker other than a restart
+			marker = -1;
+			while((ch = getc(file))!=EOF){
+				if(ch!=0xFF){
+					put(ch);
+					continue;
+				}
+				int next = getc(file);
+				while(next==0xFF)
+					next = getc(file);
+				if(next==0x00 || (next>=0xD0 && next<=0xD7)){
+					put(0xFF);
+					put(next);
+					continue;
+				}
+				marker = next;
+				break;
+			}
+		}
+		return false;
+	}
+
+	int nextMarker(){
+		int ch = getc(file);
+		if(ch!=0xFF)
+			return -1;
+		while(ch==0xFF)
+			ch = getc(file);
+		return ch==EOF ? -1 : ch;
+	}
+
+	void put(int byte){
+		data.push_back((unsigned char)byte);
+	}
+
+	FILE * file;
+	std::vector<unsigned char> data;
+};
+
+/* decodes frames of another source ahead of time on its own thread; the frame buffers are reused */
+class PrefetchSource : public FrameSource {
+public:
+	PrefetchSource(FrameSource * source, int capacity) : source(source), frames(capacity) {
+		reader = std::thread(&PrefetchSource::run, this);
+	}
+
+	~PrefetchSource(){
+		RGBImage * frame;
+		stopped = true;
+		source->interrupt();
+		while(frames.pop(frame))     // unblock the reader
+			delete frame;
+		reader.join();
+		for(size_t k=0; k<spare.size(); k++)
+			delete spare[k];
+		delete source;
+	}
+
+	bool read(RGBImage & frame){
+		RGBImage * next;
+		if(!frames.pop(next))
+			return false;
+		frame = *next;
+		std::lock_guard<std::mutex> lock(spareMutex);
+		spare.push_back(next);
+		return true;
+	}
+
+	void interrupt(){ source->interrupt(); }
+
+private:
+	void run(){
+		while(!stopped){
+			RGBImage * frame = NULL;
+			{
+				std::lock_guard<std::mutex> lock(spareMutex);
+				if(!spare.empty()){
+					frame = spare.back();
+					spare.pop_back();
+				}
+			}
+			if(!frame)
+				frame = new RGBImage;
+			if(!source->read(*frame)){
+				delete frame;
+				break;
+			}
+			frames.push(frame);
+		}
+		frames.close();
+	}
+
+	FrameSource * source;
+	BoundedQueue<RGBImage*> frames;
+	std::vector<RGBImage*> spare;
+	std::mutex spareMutex;
+	std::thread reader;
+	std::atomic<bool> stopped{false};
+};
+
+/* traces the time taken by each read of another source as the decode stage of its frame */
+class TimedSource : public FrameSource {
+public:
+	TimedSource(FrameSource * source, Tracer * tracer) : source(source), tracer(tracer), next(0) {}
+	~TimedSource(){ delete source; }
+
+	bool read(RGBImage & frame){
+		TraceFrame context(tracer, next++);
+		StageTimer timer(STAGE_DECODE);
+		return source->read(frame);
+	}
+
+	bool encoded() const { return source->encoded(); }
+	void interrupt(){ source->interrupt(); }
+
+	bool readEncoded(std::vector<unsigned char> & data){
+		TraceFrame context(tracer, next++);
+		StageTimer timer(STAGE_DECODE);
+		return source->readEncoded(data);
+	}
+
+private:
+	FrameSource * source;
+	Tracer * tracer;
+	int next;
+};
+
+/*
+    Stream on a file descriptor whose reads can be interrupted. A read waits in poll for the
+    descriptor and for a self-pipe; once interrupt() has written to the pipe, the read that waits
+    and every later read return end of file. The stream owns the object, and closing it closes the
+    descriptor, unless that is stdin.
+*/
+class InterruptibleStream {
+public:
+	/* Function to open a stream on fd and its handle; NULL if it cannot be made, with fd closed */
+	static FILE * open(int fd, InterruptibleStream * & handle){
+		cookie_io_functions_t io = { readCookie, NULL, NULL, closeCookie };
+		handle = new InterruptibleStream(fd);
+		FILE * file = handle->wake[0]>=0 ? fopencookie(handle, "rb", io) : NULL;
+		if(!file){
+			delete handle;
+			handle = NULL;
+		}
+		return file;
+	}
+
+	void interrupt(){
+		char c = 0;
+		if(write(wake[1], &c, 1)<0)
+			perror("interrupt");
+	}
+
+private:
+	InterruptibleStream(int fd) : fd(fd) {
+		if(pipe(wake)!=0)
+			wake[0] = wake[1] = -1;
+	}
+
+	~InterruptibleStream(){
+		if(wake[0]>=0){
+			::close(wake[0]);
+			::close(wake[1]);
+		}
+		if(fd!=STDIN_FILENO)
+			::close(fd);
+	}
+
+	static ssize_t readCookie(void * cookie, char * buffer, size_t size){
+		InterruptibleStream * stream = (InterruptibleStream *)cookie;
+		struct pollfd fds[2] = { { stream->fd, POLLIN, 0 }, { stream->wake[0], POLLIN, 0 } };
+		while(true){
+			if(poll(fds, 2, -1)<0){
+				if(errno==EINTR)
+					continue;
+				return -1;
+			}
+			if(fds[1].revents)
+				return 0;
+			ssize_t n = ::read(stream->fd, buffer, size);
+			if(n<0 && (errno==EINTR || errno==EAGAIN))
+				continue;
+			return n;
+		}
+	}
+
+	static int closeCookie(void * cookie){
+		delete (InterruptibleStream *)cookie;
+		return 0;
+	}
+
+	int fd, wake[2];
+};
+
+/* stream file (or stdin) that closes with its source; a live stream can be interrupted */
+template <class Source>
+class StreamSource : public Source {
+public:
+	StreamSource(FILE * file, InterruptibleStream * live) : Source(file), file(file), live(live) {}
+	~StreamSource(){
+		if(file!=stdin)
+			fclose(file);
+	}
+	void interrupt(){
+		if(live)
+			live->interrupt();
+	}
+private:
+	FILE * file;
+	InterruptibleStream * live;
+};
+
+/*
+    Capture of a live source: a thread reads the frames of another source as they arrive
+    and keeps only the newest, with its number and the time it was read. A consumer that
+    falls behind takes the newest frame and passes over the ones before it instead of
+    queueing them. A source that is not live (a file or folder) is read at rate frames
+    per second, as a camera would deliver it; with rate 0 a pipe is read at the pace of
+    its writer.
+*/
+class LiveSource {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	LiveSource(FrameSource * source, int rate) : source(source), rate(rate), published(0), taken(0), ended(false) {
+		reader = std::thread(&LiveSource::run, this);
+	}
+
+	~LiveSource(){
+		stopped = true;
+		source->interrupt();   // the reader may wait for a frame that does not come
+		reader.join();
+		delete source;
+	}
+
+	/* Function to wait for a frame newer than the last one taken; false once the source has ended and its last frame was taken */
+	bool take(RGBImage & frame, int & index, Clock::time_point & captured){
+		std::unique_lock<std::mutex> lock(mutex);
+		arrived.wait(lock, [this]{ return published>taken || ended; });
+		if(published==taken)
+			return false;
+		frame = latest;
+		index = published-1;
+		captured = latestTime;
+		taken = published;
+		return true;
+	}
+
+	/* frames read from the source so far */
+	int frames(){
+		std::lock_guard<std::mutex> lock(mutex);
+		return published;
+	}
+
+private:
+	void run(){
+		RGBImage frame;
+		Clock::time_point start = Clock::now();
+		for(int n=0; !stopped && source->read(frame); n++){
+			if(rate>0)
+				std::this_thread::sleep_until(start + std::chrono::microseconds((long long)n*1000000/rate));
+			std::lock_guard<std::mutex> lock(mutex);
+			latest = frame;
+			latestTime = Clock::now();
+			published = n+1;
+			arrived.notify_all();
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		ended = true;
+		arrived.notify_all();
+	}
+
+	FrameSource * source;
+	int rate;
+	RGBImage latest;                 // the newest frame, number published-1
+	Clock::time_point latestTime;
+	int published, taken;
+	bool ended;
+	std::mutex mutex;
+	std::condition_variable arrived;
+	std::thread reader;
+	std::atomic<bool> stopped{false};
+};
+
+/* Function to tell whether an input is live: stdin, a FIFO or a device, which deliver frames at their own pace */
+inline bool isLiveInput(const char * input){
+	struct stat info;
+	if(strcmp(input, "-")==0)
+		return true;
+	return stat(input, &info)==0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode));
+}
+
+/*
+    Open the frames named by input: "-" is a stream on stdin, an existing file or FIFO is a
+    Y4M or MJPEG stream (told apart by its first bytes), anything else is a folder
+    under images/SP/input. Returns NULL if the input cannot be read.
+    With a tracer, the decode time of every frame is traced. With compressed, JPEG frames are
+    not prefetched, since they are to be read with readEncoded and decoded by the caller.
+*/
+inline FrameSource * openFrameSource(const char * input, int prefetch, Tracer * tracer = NULL, bool compressed = false){
+	FrameSource * source;
+	struct stat info;
+
+	if(strcmp(input, "-")==0 || (stat(input, &info)==0 && (S_ISREG(info.st_mode) || S_ISFIFO(info.st_mode)))){
+		InterruptibleStream * live = NULL;
+		FILE * file;
+		if(isLiveInput(input)){
+			int fd = strcmp(input, "-")==0 ? STDIN_FILENO : ::open(input, O_RDONLY);
+			file = fd>=0 ? InterruptibleStream::open(fd, live) : NULL;
+		}
+		else
+			file = fopen(input, "rb");
+		if(!file)
+			return NULL;
+		int first = getc(file);
+		ungetc(first, file);
+		if(first=='Y')
+			source = new StreamSource<Y4MSource>(file, live);
+		else if(first==0xFF)
+			source = new StreamSource<MJPEGSource>(file, live);
+		else{
+			fprintf(stderr, "\n%s is neither YUV4MPEG2 nor MJPEG", input);
+			if(file!=stdin)
+				fclose(file);
+			return NULL;
+		}
+	}
+	else{
+		char folder[250];
+		snprintf(folder, sizeof(folder), "images/SP/input/%s", input);
+		source = new JpegFolderSource(folder);
+	}
+
+	if(tracer)
+		source = new TimedSource(source, tracer);
+	if(prefetch>0 && !(compressed && source->encoded()))
+		source = new PrefetchSource(source, prefetch);
+	return source;
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*
+    MJPEG-in-AVI output.
+    Every frame is a JPEG in its own '00dc' chunk of one AVI file, followed by an
+    idx1 index with the offset of each frame, so players can seek in the clip.
+    Frames may be added from several encoder threads and in any order; they are
+    appended in frame order. The headers are written by close(), once the
+    frame count and size are known. RIFF sizes are 32 bits, so a file holds up
+    to about 4 GB of frames.
+    The idx1 entries are spilled to a temporary file as the frames are
+    appended, and copied after the frames by close(), so the memory of the
+    writer does not grow with the clip.
+    A frame that was dropped is an empty chunk, which players show as the frame
+    before it, so the clip keeps the timing of its input.
+*/
+
+#ifndef VIDEOOUT_H
+#define VIDEOOUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <jpeglib.h>
+#include "image.h"
+
+/* Function to encode an image as a JPEG in memory */
+inline void encodeJpeg(const RGBImage & image, int quality, std::vector<unsigned char> & jpeg){
+	jpeg_compress_struct info;
+	jpeg_error_mgr error;
+	unsigned char * buffer = NULL;
+	unsigned long size = 0;
+	int width = image.width(), height = image.height();
+	std::vector<unsigned char> row((size_t)width*3);
+
+	info.err = jpeg_std_error(&error);
+	jpeg_create_compress(&info);
+	jpeg_mem_dest(&info, &buffer, &size);
+	info.image_width = width;
+	info.image_height = height;
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, quality, TRUE);
+	jpeg_start_compress(&info, TRUE);
+	while(info.next_scanline<info.image_height){
+		int y = info.next_scanline;
+		for(int x=0; x<width; x++){
+			int pixel = image(x,y);
+			row[3*x] = RED(pixel);
+			row[3*x+1] = GREEN(pixel);
+			row[3*x+2] = BLUE(pixel);
+		}
+		JSAMPROW rows[1] = { &row[0] };
+		jpeg_write_scanlines(&info, rows, 1);
+	}
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+
+	jpeg.assign(buffer, buffer+size);
+	free(buffer);
+}
+
+class AviWriter {
+public:
+	AviWriter() : file(NULL), index(NULL), width(0), height(0), rate(30), next(0), maxFrame(0), frames(0) {}
+	~AviWriter(){ close(); }
+
+	bool open(const char * filename, int framesPerSecond){
+		file = fopen(filename, "wb");
+		if(!file)
+			return false;
+		index = tmpfile();
+		if(!index){
+			fclose(file);
+			file = NULL;
+			return false;
+		}
+		rate = framesPerSecond;
+		next = maxFrame = frames = 0;
+		// room for the headers, then the movi list
+		for(int k=0; k<HEADER_SIZE; k++)
+			putc(0, file);
+		return true;
+	}
+
+	/* add frame number i, a JPEG of width x height */
+	void addFrame(int i, int frameWidth, int frameHeight, std::vector<unsigned char> & jpeg){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!file)
+			return;
+		width = frameWidth;
+		height = frameHeight;
+		pending[i].swap(jpeg);
+		appendPending();
+	}
+
+	/* mark frame number i as dropped */
+	void skipFrame(int i){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!file)
+			return;
+		pending[i].clear();
+		appendPending();
+	}
+
+	void close(){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!file)
+			return;
+		// frames that never got their predecessors
+		for(std::map<int, std::vector<unsigned char> >::iterator it=pending.begin(); it!=pending.end(); ++it)
+			append(it->second);
+		pending.clear();
+
+		long moviEnd = ftell(file);
+		fwrite("idx1", 1, 4, file);
+		put32(16*frames);
+		char buffer[16*1024];
+		size_t n;
+		rewind(index);
+		while((n = fread(buffer, 1, sizeof(buffer), index))>0)
+			fwrite(buffer, 1, n, file);
+		fclose(index);
+		index = NULL;
+		long fileEnd = ftell(file);
+
+		fseek(file, 0, SEEK_SET);
+		fwrite("RIFF", 1, 4, file);
+		put32(fileEnd-8);
+		fwrite("AVI ", 1, 4, file);
+
+		fwrite("LIST", 1, 4, file);
+		put32(4+64+12+64+48);
+		fwrite("hdrl", 1, 4, file);
+		fwrite("avih", 1, 4, file);
+		put32(56);
+		put32(1000000/rate);           // microseconds per frame
+		put32(maxFrame*rate);          // max bytes per second
+		put32(0);
+		put32(0x10);                   // has index
+		put32(frames);
+		put32(0);
+		put32(1);                      // streams
+		put32(maxFrame);
+		put32(width);
+		put32(height);
+		for(int k=0; k<4; k++)
+			put32(0);
+
+		fwrite("LIST", 1, 4, file);
+		put32(4+64+48);
+		fwrite("strl", 1, 4, file);
+		fwrite("strh", 1, 4, file);
+		put32(56);
+		fwrite("vidsMJPG", 1, 8, file);
+		put32(0);                      // flags
+		put32(0);                      // priority and language
+		put32(0);                      // initial frames
+		put32(1);                      // scale
+		put32(rate);                   // rate
+		put32(0);                      // start
+		put32(frames);                 // length
+		put32(maxFrame);
+		put32(0xFFFFFFFF);             // quality
+		put32(0);                      // sample size
+		put32(0);                      // frame rectangle
+		put32(width | height<<16);
+		fwrite("strf", 1, 4, file);
+		put32(40);
+		put32(40);                     // BITMAPINFOHEADER
+		put32(width);
+		put32(height);
+		put32(1 | 24<<16);             // planes and bits per pixel
+		fwrite("MJPG", 1, 4, file);
+		put32(width*height*3);
+		for(int k=0; k<4; k++)
+			put32(0);
+
+		fwrite("LIST", 1, 4, file);
+		put32(moviEnd-(HEADER_SIZE-4));
+		fwrite("movi", 1, 4, file);
+
+		fclose(file);
+		file = NULL;
+	}
+
+private:
+	enum { HEADER_SIZE = 224 };      // RIFF, hdrl and the start of the movi list
+
+	/* the frames that follow the last one appended */
+	void appendPending(){
+		while(pending.count(next)){
+			append(pending[next]);
+			pending.erase(next);
+			next++;
+		}
+	}
+
+	void append(std::vector<unsigned char> & jpeg){
+		fwrite("00dc", 1, 4, index);
+		put32(index, jpeg.size() ? 0x10 : 0);            // key frame, or a dropped one
+		put32(index, ftell(file)-(HEADER_SIZE-4));       // from the 'movi' tag
+		put32(index, jpeg.size());
+		frames++;
+		if((int)jpeg.size()>maxFrame)
+			maxFrame = (int)jpeg.size();
+
+		fwrite("00dc", 1, 4, file);
+		put32(jpeg.size());
+		if(!jpeg.empty())
+			fwrite(&jpeg[0], 1, jpeg.size(), file);
+		if(jpeg.size()%2)
+			putc(0, file);
+	}
+
+	void put32(unsigned long v){
+		put32(file, v);
+	}
+
+	static void put32(FILE * to, unsigned long v){
+		putc(v & 255, to);
+		putc(v>>8 & 255, to);
+		putc(v>>16 & 255, to);
+		putc(v>>24 & 255, to);
+	}
+
+	FILE * file;
+	FILE * index;                    // the idx1 entries so far
+	int width, height, rate, next, maxFrame, frames;
+	std::map<int, std::vector<unsigned char> > pending;
+	std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/*
+    Work-stealing thread pool. Each thread owns a deque of tasks, with its
+    own lock: it takes its own tasks from the back and, when it runs out,
+    steals from the front of the other threads' deques, so long tasks do not
+    leave threads idle. A task submitted by a thread of the pool goes to the
+    deque of that thread, others are dealt to the deques in turn.
+    One more lock only counts the tasks, so that a thread sleeps while there
+    are none and reserves one before it looks for it in the deques.
+    wait() blocks until every submitted task has finished.
+*/
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class WorkPool {
+public:
+	typedef std::function<void()> Task;
+
+	WorkPool(int numThreads) : queues(numThreads > 0 ? numThreads : 1), next(0), queued(0), pending(0), stop(false) {
+		for(size_t t=0; t<queues.size(); t++)
+			threads.push_back(std::thread(&WorkPool::run, this, (int)t));
+	}
+
+	~WorkPool(){
+		wait();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for(size_t t=0; t<threads.size(); t++)
+			threads[t].join();
+	}
+
+	void submit(const Task & task){
+		int t;
+		if(worker().pool==this)
+			t = worker().index;
+		else{
+			std::lock_guard<std::mutex> lock(mutex);
+			t = next++ % queues.size();
+		}
+		Queue & q = queues[t];
+		{
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.tasks.push_back(task);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		queued++;
+		pending++;
+		wake.notify_one();
+	}
+
+	void wait(){
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]{ return pending==0; });
+	}
+
+	int size() const { return (int)queues.size(); }
+
+private:
+	struct Queue {
+		std::deque<Task> tasks;
+		std::mutex mutex;
+	};
+
+	/* pool and deque of the calling thread, if it is a thread of a pool */
+	struct Worker {
+		WorkPool * pool;
+		int index;
+	};
+
+	static Worker & worker(){
+		static thread_local Worker current = { NULL, 0 };
+		return current;
+	}
+
+	bool take(int t, Task & task){
+		// own tasks first, newest first
+		{
+			Queue & q = queues[t];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if(!q.tasks.empty()){
+				task = q.tasks.back();
+				q.tasks.pop_back();
+				return true;
+			}
+		}
+		// then steal the oldest task of another thread
+		for(size_t k=1; k<queues.size(); k++){
+			Queue & q = queues[(t+k) % queues.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if(!q.tasks.empty()){
+				task = q.tasks.front();
+				q.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(int t){
+		Task task;
+		worker().pool = this;
+		worker().index = t;
+		while(true){
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]{ return queued>0 || stop; });
+				if(queued==0 && stop)
+					return;
+				queued--;
+			}
+			// a task is reserved for this thread, find it
+			while(!take(t, task))
+				std::this_thread::yield();
+			task();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--pending==0)
+				done.notify_all();
+		}
+	}
+
+	std::vector<Queue> queues;
+	std::vector<std::thread> threads;
+	unsigned next;
+	int queued, pending;
+	bool stop;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+};
+
+#endif